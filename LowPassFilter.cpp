@@ -4,12 +4,14 @@
 
 // taken from (and modified):
 // https://github.com/overlord1123/LowPassFilter
+// T is the sample type the filter computes in.
 
-class LowPassFilter{
+template<typename T>
+class BasicLowPassFilter{
 public:
-	LowPassFilter() {};
+	BasicLowPassFilter() {};
 
-	LowPassFilter(double iCutOffFrequency, double iDeltaTime):
+	BasicLowPassFilter(double iCutOffFrequency, double iDeltaTime):
 		output(0),
 		ePow(1-exp(-iDeltaTime * 2 * M_PI * iCutOffFrequency)) {
 	
@@ -20,10 +22,12 @@ public:
 		ePow = 1 - exp(-iDeltaTime * 2 * M_PI * iCutOffFrequency);
 	}
 
-	double update(double input) {
+	T update(T input) {
 		return output += (input - output) * ePow;
 	}
 private:
-	double output;
-	double ePow;
+	T output;
+	T ePow;
 };
+
+using LowPassFilter = BasicLowPassFilter<dsp_sample_t>;
@@ -0,0 +1,268 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <tuple>
+
+using namespace std;
+
+//
+// Antenna gain patterns and beam steering
+//
+// An AntennaPattern holds the amplitude gain of an antenna on a regular
+// grid over theta (angle off boresight, 0 .. 180 degrees) and phi
+// (azimuth around boresight, 0 .. 360 degrees, wrapping around), and
+// interpolates bilinearly between grid points. Patterns are made from
+// a parametric beam or read from a table file, and are converted to
+// amplitude gains once, so a lookup is a few multiplications.
+//
+// Pattern table file: '#' starts a comment. The first two numbers are
+// num_theta and num_phi, followed by num_theta rows of num_phi gains
+// in dBi. Row k is at theta = 180 k / (num_theta - 1) degrees and
+// column j at phi = 360 j / num_phi degrees. A pattern with num_phi 1
+// is symmetric around boresight.
+//
+// LinkGains gives every satellite an optional pattern (none is
+// isotropic) and a boresight that is fixed, points at nadir or tracks
+// another satellite. update() steers the boresights and evaluates the
+// gain of every link from the current positions. Links are reciprocal,
+// so one pass over satellite pairs gives both directions:
+//     gain(tx, rx) = G_tx(direction to rx) * G_rx(direction to tx)
+// Transmitters multiply the propagation loss of a link by this gain, so
+// gains only change at the rate update() is called, not per sample.
+//
+// phi is measured from a reference axis perpendicular to boresight:
+// the direction of z x boresight (x x boresight if boresight is along
+// z).
+//
+// Requires SatellitePositions (orbit.cpp).
+//
+
+class AntennaPattern {
+
+    int num_theta = 2;
+    int num_phi = 1;
+    double theta_step = M_PI;       // rad
+    double phi_step = 2 * M_PI;     // rad
+    vector<double> gains = {1, 1};  // amplitude gain at [theta * num_phi + phi]
+    int valid = 1;
+
+    void set_gains_dbi(int num_theta_in, int num_phi_in, const vector<double> &gains_dbi) {
+        this->num_theta = num_theta_in;
+        this->num_phi = num_phi_in;
+        this->theta_step = M_PI / (num_theta_in - 1);
+        this->phi_step = 2 * M_PI / num_phi_in;
+        this->gains.resize(gains_dbi.size());
+        for (size_t i = 0; i < gains_dbi.size(); ++i)
+            this->gains[i] = pow(10, gains_dbi[i] / 20);
+    }
+
+public:
+    // isotropic
+    AntennaPattern() {}
+
+    // num_theta rows of num_phi gains in dBi, see the file format above
+    AntennaPattern(int num_theta_in, int num_phi_in, const vector<double> &gains_dbi) {
+        this->valid = num_theta_in >= 2 && num_phi_in >= 1 && (long) gains_dbi.size() == (long) num_theta_in * num_phi_in;
+        if (this->valid)
+            set_gains_dbi(num_theta_in, num_phi_in, gains_dbi);
+    }
+
+    // reads a pattern table file
+    explicit AntennaPattern(const char *path) {
+        this->valid = 0;
+        ifstream file(path);
+        stringstream numbers;
+        string line;
+        while (getline(file, line))
+            numbers << line.substr(0, line.find('#')) << '\n';
+
+        int num_theta_in = 0, num_phi_in = 0;
+        if (!(numbers >> num_theta_in >> num_phi_in) || num_theta_in < 2 || num_phi_in < 1)
+            return;
+        vector<double> gains_dbi((long) num_theta_in * num_phi_in);
+        for (double &gain_dbi : gains_dbi)
+            if (!(numbers >> gain_dbi))
+                return;
+        set_gains_dbi(num_theta_in, num_phi_in, gains_dbi);
+        this->valid = 1;
+    }
+
+    // Beam with a Gaussian main lobe of half power "beamwidth" (rad,
+    // full angle) and "peak_gain_dbi" on boresight, flat at
+    // "sidelobe_gain_dbi" outside of it
+    static AntennaPattern gaussian_beam(double beamwidth, double peak_gain_dbi, double sidelobe_gain_dbi, int num_theta_in = 1801) {
+        vector<double> gains_dbi(num_theta_in);
+        for (int k = 0; k < num_theta_in; ++k)
+        {
+            double theta = M_PI * k / (num_theta_in - 1);
+            double gain_dbi = peak_gain_dbi - 12 * (theta / beamwidth) * (theta / beamwidth);
+            gains_dbi[k] = gain_dbi > sidelobe_gain_dbi ? gain_dbi : sidelobe_gain_dbi;
+        }
+        return AntennaPattern(num_theta_in, 1, gains_dbi);
+    }
+
+    int is_valid() const { return this->valid; }
+    int is_symmetric() const { return this->num_phi == 1; }
+
+    // amplitude gain at theta (rad, 0 .. pi) off boresight and azimuth
+    // phi (rad)
+    double gain(double theta, double phi) const {
+        double t = theta / this->theta_step;
+        int i = (int) t;
+        i = i < 0 ? 0 : (i > this->num_theta - 2 ? this->num_theta - 2 : i);
+        double ft = t - i;
+        const double *row = &this->gains[i * this->num_phi];
+        if (this->num_phi == 1)
+            return row[0] + ft * (row[1] - row[0]);
+
+        double p = phi / this->phi_step;
+        p -= this->num_phi * floor(p / this->num_phi);
+        int j = (int) p;
+        j = j < this->num_phi ? j : this->num_phi - 1;
+        int j_next = j + 1 < this->num_phi ? j + 1 : 0;
+        double fp = p - j;
+        double near = row[j] + fp * (row[j_next] - row[j]);
+        double far = row[this->num_phi + j] + fp * (row[this->num_phi + j_next] - row[this->num_phi + j]);
+        return near + ft * (far - near);
+    }
+};
+
+enum class BoresightMode { fixed, nadir, track };
+
+class LinkGains {
+
+    struct Antenna {
+        const AntennaPattern *pattern = NULL;   // NULL is isotropic
+        BoresightMode mode = BoresightMode::nadir;
+        int target = -1;                // satellite tracked
+        double direction[3] = {0, 0, 1};    // fixed boresight
+        double boresight[3] = {0, 0, 1};    // current boresight, unit
+        double reference[3] = {1, 0, 0};    // phi = 0 axis, unit
+    };
+
+    SatellitePositions *sat_pos;
+    int num_sats;
+    vector<Antenna> antennas;
+    vector<double> gains;       // amplitude gain at [tx * num_sats + rx]
+
+    static void normalize(double *v) {
+        double length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length > 0)
+            for (int i = 0; i < 3; ++i)
+                v[i] /= length;
+    }
+
+    void steer(int s) {
+        Antenna &antenna = this->antennas[s];
+        double x, y, z;
+        tie(x, y, z) = this->sat_pos->get_position(s);
+        double *b = antenna.boresight;
+        if (antenna.mode == BoresightMode::nadir)
+        {
+            b[0] = -x;
+            b[1] = -y;
+            b[2] = -z;
+        }
+        else if (antenna.mode == BoresightMode::track)
+        {
+            double tx, ty, tz;
+            tie(tx, ty, tz) = this->sat_pos->get_position(antenna.target);
+            b[0] = tx - x;
+            b[1] = ty - y;
+            b[2] = tz - z;
+        }
+        else
+            copy(antenna.direction, antenna.direction + 3, b);
+        normalize(b);
+
+        // z x b, or x x b if b is along z
+        double *r = antenna.reference;
+        if (fabs(b[2]) < 0.999)
+        {
+            r[0] = -b[1];
+            r[1] = b[0];
+            r[2] = 0;
+        }
+        else
+        {
+            r[0] = 0;
+            r[1] = -b[2];
+            r[2] = b[1];
+        }
+        normalize(r);
+    }
+
+    // gain of "antenna" towards unit direction d
+    static double antenna_gain(const Antenna &antenna, const double *d) {
+        const double *b = antenna.boresight;
+        double cos_theta = d[0] * b[0] + d[1] * b[1] + d[2] * b[2];
+        double theta = acos(cos_theta < -1 ? -1 : (cos_theta > 1 ? 1 : cos_theta));
+        if (antenna.pattern->is_symmetric())
+            return antenna.pattern->gain(theta, 0);
+        const double *r = antenna.reference;
+        // second axis b x r
+        double s[3] = {b[1] * r[2] - b[2] * r[1], b[2] * r[0] - b[0] * r[2], b[0] * r[1] - b[1] * r[0]};
+        double phi = atan2(d[0] * s[0] + d[1] * s[1] + d[2] * s[2], d[0] * r[0] + d[1] * r[1] + d[2] * r[2]);
+        return antenna.pattern->gain(theta, phi);
+    }
+
+public:
+    // every satellite starts isotropic
+    LinkGains(SatellitePositions *sat_pos_in)
+        : sat_pos(sat_pos_in), num_sats(sat_pos_in->get_num_sats()),
+          antennas(sat_pos_in->get_num_sats()), gains(sat_pos_in->get_num_sats() * sat_pos_in->get_num_sats(), 1) {}
+
+    // "pattern" must outlive the LinkGains, NULL is isotropic
+    void set_pattern(int sat, const AntennaPattern *pattern) { this->antennas[sat].pattern = pattern; }
+
+    void point_fixed(int sat, double x, double y, double z) {
+        Antenna &antenna = this->antennas[sat];
+        antenna.mode = BoresightMode::fixed;
+        antenna.direction[0] = x;
+        antenna.direction[1] = y;
+        antenna.direction[2] = z;
+    }
+
+    void point_nadir(int sat) { this->antennas[sat].mode = BoresightMode::nadir; }
+
+    void track(int sat, int target) {
+        this->antennas[sat].mode = BoresightMode::track;
+        this->antennas[sat].target = target;
+    }
+
+    // steers every boresight and evaluates every link at the current
+    // positions
+    void update() {
+        for (int s = 0; s < this->num_sats; ++s)
+            if (this->antennas[s].pattern != NULL)
+                steer(s);
+
+        for (int u = 0; u < this->num_sats; ++u)
+            for (int v = u + 1; v < this->num_sats; ++v)
+            {
+                const Antenna &antenna_u = this->antennas[u], &antenna_v = this->antennas[v];
+                double gain = 1;
+                if (antenna_u.pattern != NULL || antenna_v.pattern != NULL)
+                {
+                    double ux, uy, uz, vx, vy, vz;
+                    tie(ux, uy, uz) = this->sat_pos->get_position(u);
+                    tie(vx, vy, vz) = this->sat_pos->get_position(v);
+                    double d[3] = {vx - ux, vy - uy, vz - uz};
+                    normalize(d);
+                    double back[3] = {-d[0], -d[1], -d[2]};
+                    if (antenna_u.pattern != NULL)
+                        gain *= antenna_gain(antenna_u, d);
+                    if (antenna_v.pattern != NULL)
+                        gain *= antenna_gain(antenna_v, back);
+                }
+                this->gains[u * this->num_sats + v] = gain;
+                this->gains[v * this->num_sats + u] = gain;
+            }
+    }
+
+    // amplitude gain of link tx -> rx at the last update
+    double get(int tx, int rx) const { return this->gains[tx * this->num_sats + rx]; }
+};
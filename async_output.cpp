@@ -0,0 +1,195 @@
+#include <iostream>
+#include <streambuf>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+//
+// Asynchronous double buffered output writer
+//
+// The simulation loop writes records (lines) into a preallocated fill
+// buffer. When it is full, the buffer is handed to a writer thread which
+// writes it to the wrapped stream while the simulation keeps filling the
+// other buffer. Only when the writer is still busy with the previous
+// buffer does the overflow policy apply:
+//     block    - wait for the writer (backpressure, nothing lost)
+//     drop     - discard records until the writer is free
+//     decimate - discard records, and keep only one of every
+//                "decimation" records until the writer catches up
+// Records lost to drop or decimate are counted, and the count is
+// written at the end of the output.
+//
+
+enum class OverflowPolicy { block, drop, decimate };
+
+class AsyncOutputWriter {
+
+    ostream &out;
+    vector<char> buffers[2];
+    int fill_idx = 0;           // buffer currently filled by the simulation
+    size_t fill_size = 0;
+    size_t drain_size = 0;      // bytes of the other buffer to be written
+    bool drain_pending = false; // writer owns the other buffer
+    bool stop = false;
+
+    OverflowPolicy policy;
+    int decimation;
+    int decimating = 0;         // set while writer is falling behind
+    long record_count = 0;
+    long dropped_records = 0;
+
+    mutex mtx;
+    condition_variable cv;
+    thread writer;
+
+    void writer_loop() {
+        unique_lock<mutex> lock(this->mtx);
+        while (true)
+        {
+            this->cv.wait(lock, [this] { return this->drain_pending || this->stop; });
+            if (!this->drain_pending)
+                return;
+
+            // write without holding the lock so the simulation
+            // can keep filling the other buffer
+            char *data = this->buffers[1 - this->fill_idx].data();
+            size_t size = this->drain_size;
+            lock.unlock();
+            this->out.write(data, size);
+            this->out.flush();
+            lock.lock();
+
+            this->drain_pending = false;
+            this->cv.notify_all();
+        }
+    }
+
+    // hands fill buffer to the writer. Returns 0 if the writer was
+    // busy and "wait" was not set.
+    int hand_off(int wait) {
+        unique_lock<mutex> lock(this->mtx);
+        if (this->drain_pending)
+        {
+            if (!wait)
+                return 0;
+            this->cv.wait(lock, [this] { return !this->drain_pending; });
+        }
+        this->drain_size = this->fill_size;
+        this->fill_idx = 1 - this->fill_idx;
+        this->fill_size = 0;
+        this->drain_pending = true;
+        this->cv.notify_all();
+        return 1;
+    }
+
+public:
+    AsyncOutputWriter(ostream &out_in, size_t buffer_bytes, OverflowPolicy policy_in = OverflowPolicy::block, int decimation_in = 10)
+        : out(out_in)
+    {
+        this->buffers[0].resize(buffer_bytes);
+        this->buffers[1].resize(buffer_bytes);
+        this->policy = policy_in;
+        this->decimation = decimation_in;
+        this->writer = thread(&AsyncOutputWriter::writer_loop, this);
+    }
+
+    // Copies one record into the fill buffer. Records larger
+    // than the buffer are truncated.
+    void write_record(const char *data, size_t len) {
+        this->record_count++;
+        if (len > this->buffers[0].size())
+            len = this->buffers[0].size();
+
+        if (this->decimating && (this->record_count % this->decimation) != 0)
+        {
+            this->dropped_records++;
+            return;
+        }
+
+        if (this->fill_size + len > this->buffers[0].size())
+        {
+            int handed_off = hand_off(this->policy == OverflowPolicy::block);
+            if (!handed_off)
+            {
+                // writer still busy with previous buffer
+                this->dropped_records++;
+                if (this->policy == OverflowPolicy::decimate)
+                    this->decimating = 1;
+                return;
+            }
+            this->decimating = 0;
+        }
+
+        copy(data, data + len, this->buffers[this->fill_idx].data() + this->fill_size);
+        this->fill_size += len;
+    }
+
+    // writes everything buffered so far and waits until it is written
+    void flush() {
+        hand_off(1);
+        unique_lock<mutex> lock(this->mtx);
+        this->cv.wait(lock, [this] { return !this->drain_pending; });
+    }
+
+    long get_dropped_records() { return this->dropped_records; }
+
+    ~AsyncOutputWriter() {
+        flush();
+        {
+            lock_guard<mutex> lock(this->mtx);
+            this->stop = true;
+        }
+        this->cv.notify_all();
+        this->writer.join();
+        if (this->dropped_records > 0)
+            this->out << "Dropped Output Records: " << this->dropped_records << " of " << this->record_count << endl;
+    }
+};
+
+// streambuf that collects characters into lines and passes each
+// line to an AsyncOutputWriter as one record
+class AsyncOutputStreamBuf : public streambuf
+{
+    AsyncOutputWriter *writer;
+    vector<char> line;
+
+public:
+    AsyncOutputStreamBuf(AsyncOutputWriter *writer_in) : writer(writer_in) {
+        this->line.reserve(256);
+    }
+
+    virtual int overflow(int outputVal) override
+    {
+        if (outputVal == traits_type::eof())
+            return traits_type::eof();
+        this->line.push_back(static_cast<char>(outputVal));
+        if (outputVal == '\n')
+        {
+            this->writer->write_record(this->line.data(), this->line.size());
+            this->line.clear();
+        }
+        return outputVal;
+    }
+
+    virtual int sync() override
+    {
+        if (!this->line.empty())
+        {
+            this->writer->write_record(this->line.data(), this->line.size());
+            this->line.clear();
+        }
+        return 0;
+    }
+};
+
+class AsyncOutputStream : public ostream
+{
+public:
+    AsyncOutputStream(AsyncOutputWriter &writer)
+      : ostream(new AsyncOutputStreamBuf(&writer)) {
+    }
+    ~AsyncOutputStream() { this->rdbuf()->pubsync(); delete this->rdbuf(); }
+};
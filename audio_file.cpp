@@ -0,0 +1,256 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+//
+// WAV file audio source and sink
+//
+// The source memory maps a PCM WAV file and converts samples straight
+// from the mapping, so hours of audio are streamed without being read
+// into memory. The audio is resampled to the simulation time step by
+// linear interpolation. The sink averages received audio down to the
+// output sample rate and writes 16 bit PCM through a write buffer.
+//
+
+// reads little endian integers from the WAV header
+static uint32_t read_le32(const unsigned char *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24); }
+static uint16_t read_le16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+
+class WavFileSource : public AudioSource {
+
+    const unsigned char *mapping = NULL;
+    size_t mapping_size = 0;
+    const unsigned char *samples = NULL;    // start of "data" chunk
+    long num_frames = 0;
+    int num_channels = 0;
+    int bits_per_sample = 0;
+    int is_float = 0;
+    double sample_rate = 0;
+
+    double dt;
+    double gain;
+    double curr_time = 0;
+
+    // first channel of frame idx, scaled to [-1, 1]
+    double frame_value(long idx) {
+        if (idx >= this->num_frames)
+            return 0;
+        const unsigned char *p = this->samples + idx * this->num_channels * (this->bits_per_sample / 8);
+        if (this->is_float)
+        {
+            float value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+        if (this->bits_per_sample == 16)
+            return (int16_t) read_le16(p) / 32768.0;
+        // 8 bit PCM is unsigned
+        return (p[0] - 128) / 128.0;
+    }
+
+    int parse_header() {
+        if (this->mapping_size < 12 || memcmp(this->mapping, "RIFF", 4) != 0 || memcmp(this->mapping + 8, "WAVE", 4) != 0)
+            return 0;
+
+        int have_format = 0;
+        size_t pos = 12;
+        while (pos + 8 <= this->mapping_size)
+        {
+            const unsigned char *chunk = this->mapping + pos;
+            uint32_t chunk_size = read_le32(chunk + 4);
+            if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16)
+            {
+                int format = read_le16(chunk + 8);
+                this->num_channels = read_le16(chunk + 10);
+                this->sample_rate = read_le32(chunk + 12);
+                this->bits_per_sample = read_le16(chunk + 22);
+                this->is_float = (format == 3);
+                have_format = (format == 1 && (this->bits_per_sample == 8 || this->bits_per_sample == 16))
+                              || (format == 3 && this->bits_per_sample == 32);
+            }
+            else if (memcmp(chunk, "data", 4) == 0 && have_format && this->num_channels > 0)
+            {
+                size_t available = this->mapping_size - pos - 8;
+                size_t data_size = chunk_size < available ? chunk_size : available;
+                this->samples = chunk + 8;
+                this->num_frames = data_size / (this->num_channels * (this->bits_per_sample / 8));
+                return 1;
+            }
+            // chunks are padded to an even size
+            pos += 8 + chunk_size + (chunk_size & 1);
+        }
+        return 0;
+    }
+
+public:
+    // Only the first channel is used. Supports 8 and 16 bit PCM
+    // and 32 bit float WAV files.
+    WavFileSource(const char *path, double dt_in, double gain_in) {
+        this->dt = dt_in;
+        this->gain = gain_in;
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+        {
+            void *addr = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                this->mapping = (const unsigned char *) addr;
+                this->mapping_size = file_stat.st_size;
+                // file is streamed front to back
+                madvise(addr, file_stat.st_size, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+
+        if (this->mapping != NULL && !parse_header())
+            this->num_frames = 0;
+    }
+
+    // 1 if the file was mapped and has a supported format
+    int is_valid() { return this->num_frames > 0; }
+
+    // 1 once every sample of the file has been played
+    int is_finished() { return this->curr_time * this->sample_rate >= this->num_frames; }
+
+    double get_duration() { return this->num_frames / this->sample_rate; }
+
+    double get_next() override {
+        double position = this->curr_time * this->sample_rate;
+        long idx = (long) position;
+        double frac = position - idx;
+        double signal = this->gain * ((1 - frac) * frame_value(idx) + frac * frame_value(idx + 1));
+        this->curr_time += this->dt;
+        return signal;
+    }
+
+    void skip(long n) override { this->curr_time += n * this->dt; }
+
+    ~WavFileSource() {
+        if (this->mapping != NULL)
+            munmap((void *) this->mapping, this->mapping_size);
+    }
+};
+
+class WavFileSink {
+
+    ofstream file;
+    vector<int16_t> write_buffer;
+    size_t buffered = 0;
+    long frames_written = 0;
+
+    double dt;
+    double sample_rate;
+    double scale;               // full scale value of the input
+    double curr_time = 0;
+    double next_output_time;
+    double accumulated = 0;     // sum of inputs since last output sample
+    int num_accumulated = 0;
+
+    void write_header(uint32_t data_bytes) {
+        unsigned char header[44];
+        uint32_t rate = (uint32_t) this->sample_rate;
+        uint32_t fields[] = {36 + data_bytes, 16, rate, rate * 2, data_bytes};
+
+        memcpy(header, "RIFF", 4);
+        memcpy(header + 4, &fields[0], 4);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        memcpy(header + 16, &fields[1], 4);
+        uint16_t format_fields[] = {1, 1};  // PCM, one channel
+        memcpy(header + 20, format_fields, 4);
+        memcpy(header + 24, &fields[2], 4);
+        memcpy(header + 28, &fields[3], 4);
+        uint16_t align_fields[] = {2, 16};  // block align, bits per sample
+        memcpy(header + 32, align_fields, 4);
+        memcpy(header + 36, "data", 4);
+        memcpy(header + 40, &fields[4], 4);
+
+        this->file.seekp(0);
+        this->file.write((const char *) header, sizeof(header));
+    }
+
+    // writes the average of the accumulated inputs as one frame
+    void write_frame() {
+        double value = this->accumulated / this->num_accumulated / this->scale;
+        value = value > 1 ? 1 : (value < -1 ? -1 : value);
+        this->write_buffer[this->buffered++] = (int16_t) lround(value * 32767);
+        this->frames_written++;
+        if (this->buffered == this->write_buffer.size())
+            flush_buffer();
+
+        this->accumulated = 0;
+        this->num_accumulated = 0;
+        this->next_output_time = (this->frames_written + 1) / this->sample_rate;
+    }
+
+    void flush_buffer() {
+        this->file.write((const char *) this->write_buffer.data(), this->buffered * sizeof(int16_t));
+        this->buffered = 0;
+    }
+
+public:
+    // "scale" is the input value that maps to full scale
+    WavFileSink(const char *path, double dt_in, double sample_rate_in, double scale_in, size_t buffer_samples = 1 << 16)
+        : file(path, ios::binary | ios::trunc)
+    {
+        this->dt = dt_in;
+        this->sample_rate = sample_rate_in;
+        this->scale = scale_in;
+        this->next_output_time = 1 / sample_rate_in;
+        this->write_buffer.resize(buffer_samples);
+        if (this->file)
+            write_header(0);
+    }
+
+    int is_valid() { return (bool) this->file; }
+
+    // takes one received audio sample per simulation time step
+    void write(double signal) {
+        this->accumulated += signal;
+        this->num_accumulated++;
+        this->curr_time += this->dt;
+        if (this->curr_time < this->next_output_time)
+            return;
+        write_frame();
+    }
+
+    // takes n silent time steps at once. Silent steps count towards
+    // the average of the frame they fall in, like n calls of write(0).
+    void write_silence(long n) {
+        while (n > 0)
+        {
+            // steps up to the end of the current frame
+            long steps = (long) ceil((this->next_output_time - this->curr_time) / this->dt - 1e-9);
+            steps = steps < 1 ? 1 : steps;
+            if (steps > n)
+            {
+                this->num_accumulated += n;
+                this->curr_time += n * this->dt;
+                return;
+            }
+            this->num_accumulated += steps;
+            this->curr_time += steps * this->dt;
+            n -= steps;
+            write_frame();
+        }
+    }
+
+    ~WavFileSink() {
+        if (!this->file)
+            return;
+        flush_buffer();
+        write_header(this->frames_written * sizeof(int16_t));
+    }
+};
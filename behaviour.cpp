@@ -0,0 +1,289 @@
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+
+using namespace std;
+
+//
+// Scripted satellite behaviours on an event scheduler
+//
+// Each satellite runs a behaviour, a resumable sequence of phases such
+// as "transmit burst, wait, relay for 10 s, idle until pass". The
+// scheduler resumes a behaviour only when its current phase ends, from
+// a queue ordered by wake up time. Satellites that are idle are not
+// touched at all: when they wake up their orbit is advanced
+// analytically and their signal processors skip ahead (skip_time).
+// When every satellite is idle the scheduler jumps straight to the
+// next wake up.
+//
+// A satellite that stops transmitting keeps sending silence until its
+// delay line has drained, so receivers see the tail of its signal.
+//
+// Receivers can be demodulated together by a ReceiverBank.
+//
+// Requires Satellite (satellite.cpp), AudioSource (data_source.cpp)
+// and WavFileSink (audio_file.cpp).
+//
+
+enum class BehaviourAction { idle, transmit, relay, receive };
+
+struct BehaviourPhase {
+    BehaviourAction action;
+    long duration;      // time steps, negative means forever
+};
+
+// Sequence of phases, optionally repeated. next() resumes the script
+// where it left off and returns the next phase.
+class BehaviourScript {
+
+    struct Step {
+        BehaviourAction action;
+        long duration;
+        function<long(long)> wake_at;   // for idle_until, step to wake up at
+    };
+
+    vector<Step> steps;
+    size_t curr_step = 0;
+    int repeating = 0;
+
+public:
+    BehaviourScript &transmit(long duration) { this->steps.push_back({BehaviourAction::transmit, duration, nullptr}); return *this; }
+    BehaviourScript &relay(long duration) { this->steps.push_back({BehaviourAction::relay, duration, nullptr}); return *this; }
+    BehaviourScript &receive(long duration) { this->steps.push_back({BehaviourAction::receive, duration, nullptr}); return *this; }
+    BehaviourScript &idle(long duration) { this->steps.push_back({BehaviourAction::idle, duration, nullptr}); return *this; }
+
+    // idle until the time step returned by "wake_at", which is called
+    // with the current time step (for example the start of the next pass)
+    BehaviourScript &idle_until(function<long(long)> wake_at) {
+        this->steps.push_back({BehaviourAction::idle, 0, wake_at});
+        return *this;
+    }
+
+    // start again from the first phase after the last one
+    BehaviourScript &repeat() { this->repeating = 1; return *this; }
+
+    // phase starting at time step "now". Zero length phases are
+    // skipped. Idle forever once the script has ended.
+    BehaviourPhase next(long now) {
+        // a repeating script whose phases all have zero length would
+        // never yield, so give up after one pass without a phase
+        for (size_t tries = 0; tries <= this->steps.size(); ++tries)
+        {
+            if (this->curr_step == this->steps.size())
+            {
+                if (!this->repeating || this->steps.empty())
+                    break;
+                this->curr_step = 0;
+            }
+            Step &step = this->steps[this->curr_step++];
+            long duration = step.wake_at ? step.wake_at(now) - now : step.duration;
+            if (duration != 0)
+                return BehaviourPhase{step.action, duration};
+        }
+        return BehaviourPhase{BehaviourAction::idle, -1};
+    }
+};
+
+class BehaviourScheduler {
+
+    struct Agent {
+        BehaviourScript script;
+        BehaviourAction action = BehaviourAction::idle;
+        int awake = 0;
+        int draining = 0;       // sending silence until delay line drains
+        long synced_step = 0;   // first time step not yet simulated
+    };
+
+    vector<Satellite> &satellites;
+    AudioSource &audio_source;
+    vector<Agent> agents;
+    // (wake up time step, satellite), earliest first
+    priority_queue<pair<long, int>, vector<pair<long, int>>, greater<pair<long, int>>> wake_queue;
+    vector<int> awake;      // satellites simulated this time step, by id
+    WavFileSink *audio_sink = NULL;     // optional, gets audio of last satellite
+    // optional, demodulates all receivers at once. Lane i is satellite i.
+    unique_ptr<ReceiverBank> receiver_bank;
+    vector<double> bank_rf;
+    vector<unsigned char> bank_active;
+    vector<dsp_sample_t> received_audio;    // received audio of each satellite
+    long idle_steps = 0;
+
+    void set_awake(int id, int is_awake) {
+        Agent &agent = this->agents[id];
+        if (agent.awake == is_awake)
+            return;
+        agent.awake = is_awake;
+        auto pos = lower_bound(this->awake.begin(), this->awake.end(), id);
+        if (is_awake)
+            this->awake.insert(pos, id);
+        else
+            this->awake.erase(pos);
+    }
+
+    // resumes the behaviour of satellite "id" at time step "step"
+    void wake(int id, long step) {
+        Agent &agent = this->agents[id];
+        BehaviourAction previous = agent.action;
+        BehaviourPhase phase = agent.script.next(step);
+        agent.action = phase.action;
+        if (phase.duration > 0)
+            this->wake_queue.push({step + phase.duration, id});
+
+        int transmitting = phase.action == BehaviourAction::transmit || phase.action == BehaviourAction::relay;
+        if (transmitting)
+            agent.draining = 0;
+        else if (previous == BehaviourAction::transmit || previous == BehaviourAction::relay)
+            agent.draining = 1;
+
+        if (phase.action == BehaviourAction::idle && !agent.draining)
+        {
+            if (agent.awake)
+                agent.synced_step = step;
+            set_awake(id, 0);
+            return;
+        }
+        // catch up on the time steps spent sleeping
+        if (!agent.awake && agent.synced_step < step)
+            this->satellites[id].skip_time(step - agent.synced_step);
+        set_awake(id, 1);
+    }
+
+public:
+    // all satellites are idle until a script is set
+    BehaviourScheduler(vector<Satellite> &satellites_in, AudioSource &audio_source_in)
+        : satellites(satellites_in), audio_source(audio_source_in), agents(satellites_in.size()),
+          bank_rf(satellites_in.size()), bank_active(satellites_in.size()), received_audio(satellites_in.size()) {}
+
+    void set_script(int sat_id, const BehaviourScript &script) { this->agents[sat_id].script = script; }
+
+    void set_audio_sink(WavFileSink *audio_sink_in) { this->audio_sink = audio_sink_in; }
+
+    // Receivers are demodulated by a ReceiverBank instead of their own
+    // rx processors. Returns 0 if the processors are not supported.
+    int use_receiver_bank() {
+        this->receiver_bank = make_unique<ReceiverBank>();
+        AddReceiverBankLane add_lane(*this->receiver_bank);
+        for (Satellite &satellite : this->satellites)
+        {
+            satellite.accept_rx_visitor(add_lane);
+            if (add_lane.lane < 0)
+            {
+                this->receiver_bank.reset();
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    // time steps in which no satellite was simulated
+    long get_idle_steps() { return this->idle_steps; }
+
+    void run(long num_time_steps, ostream &ins) {
+        int audio_sat = this->satellites.size() - 1;
+        for (size_t id = 0; id < this->agents.size(); ++id)
+            this->wake_queue.push({0, id});
+
+        for (long step = 0; step < num_time_steps; )
+        {
+            while (!this->wake_queue.empty() && this->wake_queue.top().first <= step)
+            {
+                int id = this->wake_queue.top().second;
+                this->wake_queue.pop();
+                wake(id, step);
+            }
+
+            if (this->awake.empty())
+            {
+                long next = this->wake_queue.empty() ? num_time_steps : this->wake_queue.top().first;
+                long skip = (next < num_time_steps ? next : num_time_steps) - step;
+                this->audio_source.skip(skip);
+                // the satellites catch up with skip_time when they wake
+                if (this->receiver_bank != NULL)
+                    this->receiver_bank->skip(skip);
+                if (this->audio_sink != NULL)
+                    this->audio_sink->write_silence(skip);
+                ins << "Idle: " << skip << " time steps from Time Step: " << step << endl;
+                this->idle_steps += skip;
+                step += skip;
+                continue;
+            }
+
+            ins << "Time Step: " << step << indent << endl;
+            double audio_signal = this->audio_source.get_next();
+            double audio_out = 0;
+
+            // same order as main: transmitters, relays, then receivers
+            for (int id : this->awake)
+            {
+                Agent &agent = this->agents[id];
+                if (agent.action == BehaviourAction::transmit)
+                {
+                    this->satellites[id].move_one_frame();
+                    this->satellites[id].transmit_signal(audio_signal);
+                    ins << "Transmitted RF Sample (Satellite " << id << "): " << this->satellites[id].get_last_processed_tx_sample() << endl;
+                }
+                else if (agent.action == BehaviourAction::idle)
+                {
+                    this->satellites[id].move_one_frame();
+                    this->satellites[id].transmit_silence();
+                }
+            }
+            for (int id : this->awake)
+                if (this->agents[id].action == BehaviourAction::relay)
+                {
+                    this->satellites[id].move_one_frame();
+                    this->satellites[id].retransmit();
+                }
+            for (int id : this->awake)
+            {
+                Agent &agent = this->agents[id];
+                if (agent.action != BehaviourAction::receive)
+                    continue;
+                this->satellites[id].move_one_frame();
+                if (this->receiver_bank != NULL)
+                {
+                    // demodulated below, together with all other receivers
+                    this->bank_rf[id] = this->satellites[id].receive_rf();
+                    this->bank_active[id] = 1;
+                }
+                else
+                    this->received_audio[id] = this->satellites[id].receive_signal(0);
+                if (agent.draining)
+                    this->satellites[id].transmit_silence();
+            }
+            if (this->receiver_bank != NULL)
+                this->receiver_bank->process(this->bank_rf.data(), this->bank_active.data(), this->received_audio.data());
+            for (int id : this->awake)
+            {
+                if (this->agents[id].action != BehaviourAction::receive)
+                    continue;
+                this->bank_active[id] = 0;
+                if (id == audio_sat)
+                    audio_out = this->received_audio[id];
+                ins << "Received Audio Sample (Satellite " << id << "): " << this->received_audio[id] << endl;
+            }
+            ins << unindent;
+            if (this->audio_sink != NULL)
+                this->audio_sink->write(audio_out);
+
+            // satellites that have drained and are idle go to sleep
+            for (size_t k = 0; k < this->awake.size(); )
+            {
+                int id = this->awake[k];
+                Agent &agent = this->agents[id];
+                if (agent.draining && this->satellites[id].is_drained())
+                    agent.draining = 0;
+                if (agent.action == BehaviourAction::idle && !agent.draining)
+                {
+                    agent.synced_step = step + 1;
+                    set_awake(id, 0);
+                    continue;
+                }
+                ++k;
+            }
+            ++step;
+        }
+    }
+};
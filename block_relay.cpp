@@ -0,0 +1,243 @@
+#include <iostream>
+#include <vector>
+#include <future>
+#include <climits>
+
+using namespace std;
+
+//
+// Block granular relay engine
+//
+// Instead of walking every relay once per sample, each satellite
+// processes a whole block of time steps at a time:
+//     1. tx satellite modulates a block of audio and pushes it into its
+//        delay line
+//     2. relays receive the block (field summed from every transmitter's
+//        delay line), demodulate and remodulate it (or forward it
+//        transparently) and push it into their own delay line
+//     3. rx satellite receives and demodulates the block
+//     4. orbits are advanced by the block length
+// A relay only depends on another relay within a block if the link
+// between them is shorter than the block. Relays are grouped into
+// levels from those dependencies, and all relays in a level run
+// concurrently. If relays depend on each other both ways, the block is
+// shortened to the shortest relay to relay latency, which removes
+// every dependency inside a block.
+//
+// With a ContactIndex, only pairs of satellites that are in contact
+// at some time during a block are evaluated, every other pair is
+// skipped.
+//
+// Satellite 0 transmits, the last one receives and the rest relay, as
+// in main. Requires Satellite (satellite.cpp), AudioSource
+// (data_source.cpp), WavFileSink (audio_file.cpp), SimulationTrace
+// (trace.cpp) and ContactIndex (contact_windows.cpp).
+//
+
+class BlockRelayEngine {
+
+    vector<Satellite> &satellites;
+    AudioSource &wave_gen;
+    WavFileSink *audio_sink = NULL;     // optional, gets received audio
+    SimulationTrace *trace = NULL;      // optional, records every step
+    const ContactIndex *contacts = NULL;    // optional, links that are up
+    double dt = 0;                      // time step, for looking up contacts
+    vector<unsigned char> linked;       // [tx * num_sats + rx] is up during current block
+    vector<double> trace_positions;
+    int num_sats;
+    int block_size;
+    int transparent;        // forward RF instead of demodulating / remodulating
+    double relay_gain;      // gain used for transparent forwarding
+
+    vector<vector<int>> relay_levels;   // relays that can run concurrently
+    vector<int> is_pushed;              // satellite's block is in its delay line
+    vector<vector<double>> rx_blocks;   // RF received by each satellite for current block
+    vector<vector<double>> tx_blocks;   // RF transmitted by each satellite for current block
+    vector<double> audio_in;
+    vector<double> audio_out;
+
+    // Groups relays into levels so that a relay only depends on relays
+    // of earlier levels within a block of n samples. Returns the block
+    // length that can be used (n, or shorter if relays depend on each
+    // other both ways).
+    int plan_levels(int n) {
+        int rx_sat = this->num_sats - 1;
+        int min_latency = INT_MAX;
+        vector<int> num_deps(this->num_sats, 0);
+        vector<vector<int>> dependents(this->num_sats);
+
+        for (int u = 1; u < rx_sat; ++u)
+            for (int v = 1; v < rx_sat; ++v)
+            {
+                if (u == v || !is_linked(u, v))
+                    continue;
+                int latency = this->satellites[u].link_latency(v);
+                if (latency < min_latency)
+                    min_latency = latency;
+                // v needs samples of u from the current block
+                if (latency < n)
+                {
+                    dependents[u].push_back(v);
+                    num_deps[v]++;
+                }
+            }
+
+        // Kahn's algorithm, one level at a time
+        this->relay_levels.clear();
+        vector<int> level;
+        for (int v = 1; v < rx_sat; ++v)
+            if (num_deps[v] == 0)
+                level.push_back(v);
+        int num_planned = 0;
+        while (!level.empty())
+        {
+            num_planned += level.size();
+            vector<int> next_level;
+            for (int u : level)
+                for (int v : dependents[u])
+                    if (--num_deps[v] == 0)
+                        next_level.push_back(v);
+            this->relay_levels.push_back(level);
+            level = next_level;
+        }
+
+        if (num_planned == rx_sat - 1)
+            return n;
+
+        // dependency cycle. Blocks no longer than the shortest
+        // relay to relay link have no dependencies inside a block.
+        int shorter = min_latency > 1 ? min_latency : 1;
+        this->relay_levels.clear();
+        vector<int> all_relays;
+        for (int v = 1; v < rx_sat; ++v)
+            all_relays.push_back(v);
+        this->relay_levels.push_back(all_relays);
+        return shorter;
+    }
+
+    // field at satellite rx_sat_id for the current block
+    void receive_block(int rx_sat_id, int n) {
+        vector<double> &rf = this->rx_blocks[rx_sat_id];
+        fill(rf.begin(), rf.begin() + n, 0);
+        // rx satellite never transmits
+        for (int s = 0; s < this->num_sats - 1; ++s)
+            if (s != rx_sat_id && is_linked(s, rx_sat_id))
+                this->satellites[s].add_field_block_at_satellite(rx_sat_id, rf.data(), n, this->is_pushed[s]);
+        this->satellites[rx_sat_id].add_receiver_noise_block(rf.data(), n);
+    }
+
+    int is_linked(int tx_sat_id, int rx_sat_id) {
+        return this->contacts == NULL || this->linked[tx_sat_id * this->num_sats + rx_sat_id];
+    }
+
+    void relay_block(int sat_id, int n) {
+        receive_block(sat_id, n);
+        this->satellites[sat_id].retransmit_block(this->rx_blocks[sat_id].data(),
+            this->tx_blocks[sat_id].data(), n, this->transparent, this->relay_gain);
+    }
+
+public:
+    BlockRelayEngine(vector<Satellite> &satellites_in, AudioSource &wave_gen_in, int block_size_in, int transparent_in = 0, double relay_gain_in = 1)
+        : satellites(satellites_in), wave_gen(wave_gen_in)
+    {
+        this->num_sats = satellites_in.size();
+        this->block_size = block_size_in;
+        this->transparent = transparent_in;
+        this->relay_gain = relay_gain_in;
+        this->is_pushed.resize(this->num_sats);
+        this->rx_blocks.assign(this->num_sats, vector<double>(block_size_in));
+        this->tx_blocks.assign(this->num_sats, vector<double>(block_size_in));
+        this->audio_in.resize(block_size_in);
+        this->audio_out.resize(block_size_in);
+        this->trace_positions.resize(3 * this->num_sats);
+    }
+
+    void set_audio_sink(WavFileSink *audio_sink_in) { this->audio_sink = audio_sink_in; }
+    void set_trace(SimulationTrace *trace_in) { this->trace = trace_in; }
+
+    // Links are only evaluated inside the contact windows of
+    // "contacts_in", whose times start at 0 at the first time step.
+    void set_contact_index(const ContactIndex *contacts_in, double dt_in) {
+        this->contacts = contacts_in;
+        this->dt = dt_in;
+    }
+
+    void run(long num_time_steps, ostream &ins) {
+        int tx_sat = 0;
+        int rx_sat = this->num_sats - 1;
+
+        for (long step = 0; step < num_time_steps; )
+        {
+            long remaining = num_time_steps - step;
+            int n = remaining < this->block_size ? remaining : this->block_size;
+            // links up at some time during the longest possible block
+            if (this->contacts != NULL)
+                this->contacts->find_links(step * this->dt, (step + n) * this->dt, this->linked);
+            // dependencies change with geometry, so plan every block
+            n = plan_levels(n);
+            fill(this->is_pushed.begin(), this->is_pushed.end(), 0);
+
+            // transmit
+            for (int k = 0; k < n; ++k)
+            {
+                this->audio_in[k] = this->wave_gen.get_next();
+                this->tx_blocks[tx_sat][k] = this->satellites[tx_sat].modulate(this->audio_in[k]);
+            }
+            this->satellites[tx_sat].propagate_block(this->tx_blocks[tx_sat].data(), n);
+            this->is_pushed[tx_sat] = 1;
+
+            // relay, one level at a time. Delay lines are only written
+            // after every relay of the level has read its input.
+            for (vector<int> &level : this->relay_levels)
+            {
+                vector<future<void>> tasks;
+                for (size_t r = 1; r < level.size(); ++r)
+                    tasks.push_back(async(launch::async, &BlockRelayEngine::relay_block, this, level[r], n));
+                relay_block(level[0], n);
+                for (future<void> &task : tasks)
+                    task.get();
+
+                for (int sat_id : level)
+                {
+                    this->satellites[sat_id].propagate_block(this->tx_blocks[sat_id].data(), n);
+                    this->is_pushed[sat_id] = 1;
+                }
+            }
+
+            // receive
+            receive_block(rx_sat, n);
+            for (int k = 0; k < n; ++k)
+            {
+                this->audio_out[k] = this->satellites[rx_sat].demodulate(this->rx_blocks[rx_sat][k]);
+                if (this->audio_sink != NULL)
+                    this->audio_sink->write(this->audio_out[k]);
+            }
+
+            // move satellites through the block
+            for (int k = 0; k < n; ++k)
+            {
+                for (int s = 0; s < this->num_sats; ++s)
+                    this->satellites[s].move_one_frame();
+                if (this->trace == NULL)
+                    continue;
+                for (int s = 0; s < this->num_sats; ++s)
+                    tie(this->trace_positions[3 * s], this->trace_positions[3 * s + 1], this->trace_positions[3 * s + 2])
+                        = this->satellites[s].get_cartesian_position();
+                this->trace->record_positions(this->trace_positions.data(), this->num_sats);
+            }
+
+            for (int k = 0; k < n; ++k)
+            {
+                if (this->trace != NULL)
+                    this->trace->record_step(this->audio_in[k], this->tx_blocks[tx_sat][k],
+                        this->rx_blocks[rx_sat][k], this->audio_out[k]);
+                ins << "Time Step: " << step + k << indent << endl;
+                ins << "Transmitted Audio Sample: " << this->audio_in[k] << endl;
+                ins << "Transmitted RF Sample: " << this->tx_blocks[tx_sat][k] << endl;
+                ins << "Received RF Sample: " << this->rx_blocks[rx_sat][k] << endl;
+                ins << "Received Audio Sample: " << this->audio_out[k] << unindent << endl;
+            }
+            step += n;
+        }
+    }
+};
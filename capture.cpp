@@ -0,0 +1,212 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+//
+// Triggered capture
+//
+// A CaptureTap sits on one signal of a Transmitter or Receiver (audio
+// in, RF out, RF in, audio out) and keeps the last pre + post + 1
+// samples in a ring that is continuously overwritten. Any tap can
+// carry a trigger on the level of its signal. When it fires at time
+// step s, every tap of the CaptureSet writes its samples of steps
+// s - pre .. s + post to the capture file, once step s + post is
+// over. Nothing else is written, so long runs only produce output
+// around the events of interest, at full resolution.
+//
+// The level is the mean |sample| over an exponential window of
+// envelope_time seconds (for a carrier of amplitude a that is
+// 2a / pi), or |sample| when envelope_time is 0. A trigger fires when
+// the condition has held for hold_steps steps in a row, e.g. the level
+// staying below a threshold for a dropout. It only fires after the
+// condition was false (a link that starts silent is no dropout), and
+// re-arms once it is false again. Triggers during a capture are part
+// of it.
+//
+// Taps take one sample per time step. The loop calls
+// CaptureSet::end_step after each step, and steps in which a tap got
+// no sample are recorded as NaN. CaptureSet::finish at the end of the
+// run writes a capture whose post trigger steps didn't all happen,
+// with fewer samples.
+//
+// File format: a sequence of records, each a CaptureRecordHeader
+// followed by num_samples doubles. Print with capture_dump.cpp.
+//
+
+enum class TriggerCondition { none, above, below };
+
+struct CaptureTrigger {
+    TriggerCondition condition = TriggerCondition::none;
+    double threshold = 0;
+    double envelope_time = 0;   // s, 0 uses |sample|
+    long hold_steps = 1;
+};
+
+struct CaptureRecordHeader {
+    char magic[4];              // "CAPT"
+    char tap_name[28];          // zero terminated
+    int64_t trigger_step;       // step the trigger fired at
+    int64_t first_step;         // step of the first sample
+    int64_t num_samples;
+    double dt;                  // s per step
+};
+
+class CaptureSet;
+
+class CaptureTap {
+
+    CaptureSet *capture_set;
+    string name;
+    vector<double> ring;        // sample of step s at [s % ring.size()]
+    long last_step = -1;        // last step with a sample
+
+    CaptureTrigger trigger;
+    double envelope_alpha = 1;
+    double level = 0;
+    long steps_held = 0;
+    int armed = 0;              // condition was false since the last firing
+
+public:
+    CaptureTap(CaptureSet *capture_set_in, const string &name_in, long ring_size)
+        : capture_set(capture_set_in), name(name_in), ring(ring_size, NAN) {}
+
+    void set_trigger(const CaptureTrigger &trigger_in, double dt) {
+        this->trigger = trigger_in;
+        this->envelope_alpha = trigger_in.envelope_time > 0 ? 1 - exp(-dt / trigger_in.envelope_time) : 1;
+    }
+
+    inline void push(double sample);
+
+    // records a NaN if the tap got no sample in step "step"
+    void fill_gap(long step) {
+        if (this->last_step != step)
+            this->ring[step % this->ring.size()] = NAN;
+    }
+
+    // appends steps first .. last to "out" (they must still be in the ring)
+    void copy_window(long first, long last, vector<double> &out) {
+        for (long s = first; s <= last; ++s)
+            out.push_back(this->ring[s % this->ring.size()]);
+    }
+
+    const string &get_name() { return this->name; }
+};
+
+class CaptureSet {
+
+    ofstream file;
+    double dt;
+    long pre_trigger;           // steps
+    long post_trigger;          // steps
+    vector<unique_ptr<CaptureTap>> taps;
+
+    long step = 0;              // current time step
+    long trigger_step = -1;     // step of the capture in progress, -1 if none
+    long num_captures = 0;
+    vector<double> window;
+
+    // writes steps trigger_step - pre_trigger .. last of every tap
+    void write_window(long last) {
+        long first = this->trigger_step - this->pre_trigger > 0 ? this->trigger_step - this->pre_trigger : 0;
+        for (unique_ptr<CaptureTap> &tap : this->taps)
+        {
+            this->window.clear();
+            tap->copy_window(first, last, this->window);
+
+            CaptureRecordHeader header = {};
+            memcpy(header.magic, "CAPT", 4);
+            strncpy(header.tap_name, tap->get_name().c_str(), sizeof(header.tap_name) - 1);
+            header.trigger_step = this->trigger_step;
+            header.first_step = first;
+            header.num_samples = this->window.size();
+            header.dt = this->dt;
+            this->file.write((const char *) &header, sizeof(header));
+            this->file.write((const char *) this->window.data(), this->window.size() * sizeof(double));
+        }
+        this->file.flush();
+        this->num_captures++;
+    }
+
+public:
+    // pre_trigger and post_trigger are in seconds
+    CaptureSet(const char *path, double dt_in, double pre_trigger_in, double post_trigger_in)
+        : file(path, ios::binary | ios::trunc)
+    {
+        this->dt = dt_in;
+        this->pre_trigger = lround(pre_trigger_in / dt_in);
+        this->post_trigger = lround(post_trigger_in / dt_in);
+    }
+
+    int is_valid() { return (bool) this->file; }
+
+    CaptureTap *add_tap(const string &name) {
+        this->taps.push_back(make_unique<CaptureTap>(this, name, this->pre_trigger + this->post_trigger + 1));
+        return this->taps.back().get();
+    }
+
+    CaptureTap *add_tap(const string &name, const CaptureTrigger &trigger) {
+        CaptureTap *tap = add_tap(name);
+        tap->set_trigger(trigger, this->dt);
+        return tap;
+    }
+
+    long get_step() { return this->step; }
+
+    // called by a tap whose trigger fired in the current step
+    void fire() {
+        if (this->trigger_step < 0)
+            this->trigger_step = this->step;
+    }
+
+    // closes the current time step, after every tap took its sample
+    void end_step() {
+        for (unique_ptr<CaptureTap> &tap : this->taps)
+            tap->fill_gap(this->step);
+        if (this->trigger_step >= 0 && this->step == this->trigger_step + this->post_trigger)
+        {
+            write_window(this->step);
+            this->trigger_step = -1;
+        }
+        this->step++;
+    }
+
+    // Writes a capture still in progress when the run ends, cut off at
+    // the last step. Call after the last end_step.
+    void finish() {
+        if (this->trigger_step < 0)
+            return;
+        write_window(this->step - 1);
+        this->trigger_step = -1;
+    }
+
+    long get_num_captures() { return this->num_captures; }
+};
+
+inline void CaptureTap::push(double sample) {
+    long step = this->capture_set->get_step();
+    this->ring[step % this->ring.size()] = sample;
+    this->last_step = step;
+
+    if (this->trigger.condition == TriggerCondition::none)
+        return;
+    this->level += this->envelope_alpha * (fabs(sample) - this->level);
+    int holds = this->trigger.condition == TriggerCondition::above ? this->level > this->trigger.threshold : this->level < this->trigger.threshold;
+    if (!holds)
+    {
+        this->steps_held = 0;
+        this->armed = 1;
+        return;
+    }
+    if (++this->steps_held >= this->trigger.hold_steps && this->armed)
+    {
+        this->armed = 0;
+        this->capture_set->fire();
+    }
+}
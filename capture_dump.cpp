@@ -0,0 +1,53 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include "capture.cpp"
+
+//
+// Prints the windows of a capture file (see capture.cpp) as text, one
+// "time step, time, value" line per sample. Build separately:
+//
+// clang++ capture_dump.cpp -std=c++17 -o capture_dump
+//
+// and run like "./capture_dump capture.bin" or
+// "./capture_dump capture.bin "rx rf"" for one tap only.
+//
+
+using namespace std;
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2) {
+        cout << "Please provide a capture file" << endl;
+        return 0;
+    }
+    ifstream file(argv[1], ios::binary);
+    if (!file) {
+        cout << "Could not read capture file: " << argv[1] << endl;
+        return 0;
+    }
+    string tap_filter = argc > 2 ? argv[2] : "";
+
+    CaptureRecordHeader header;
+    vector<double> samples;
+    while (file.read((char *) &header, sizeof(header)))
+    {
+        if (memcmp(header.magic, "CAPT", 4) != 0) {
+            cout << "Not a capture record" << endl;
+            return 0;
+        }
+        samples.resize(header.num_samples);
+        if (!file.read((char *) samples.data(), samples.size() * sizeof(double))) {
+            cout << "Truncated capture record" << endl;
+            return 0;
+        }
+        if (!tap_filter.empty() && tap_filter != header.tap_name)
+            continue;
+
+        cout << "Tap: " << header.tap_name << ", Trigger Step: " << header.trigger_step
+             << ", Trigger Time: " << header.trigger_step * header.dt << " s" << endl;
+        for (long k = 0; k < header.num_samples; ++k)
+            cout << header.first_step + k << ", " << (header.first_step + k) * header.dt << ", " << samples[k] << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,229 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+//
+// Channel impairments
+//
+// Adds, on top of the propagation loss:
+//     - white Gaussian noise at every receiver, every time step, with
+//       the noise floor of a link budget (transmit power, antenna
+//       gains, receiver noise temperature and bandwidth). The budget's
+//       received power falls with distance like the propagation loss,
+//       so each link alone has the SNR of the budget at its distance.
+//     - optionally, phase noise: the carrier phase of every link does
+//       a random walk whose spread is set by the oscillator linewidth
+//
+// Receiver noise is counter based: the noise of receiver rx at time
+// step t is a hash of (seed, rx, t), so per sample and block engines
+// get exactly the same noise, whether or not any signal has arrived.
+// Noise is generated a block at a time with a branch free Box-Muller
+// transform (polynomial log and cos), which the compiler vectorizes at
+// -O3 -march=native -fno-math-errno (sqrt otherwise sets errno).
+//
+// Phase noise rotates the received carrier, using the sample a quarter
+// carrier period earlier as the quadrature component (narrowband
+// signals only). Its increments are counter based too, but the walk
+// itself is state kept per link (phase, phase_next_step) and advanced
+// by the calls for that link: steps that aren't passed are covered by
+// one increment with their combined spread. A link's phase therefore
+// depends on which time steps were evaluated for it, e.g. engines that
+// skip the steps before the signal arrives or while the delay line is
+// freed get a different, equally distributed, walk.
+//
+
+const double boltzmann_constant = 1.380649e-23;     // J/K
+
+struct LinkBudget {
+    double tx_power = 1;                // W, at the nominal RF level
+    double tx_antenna_gain = 1;         // linear
+    double rx_antenna_gain = 1;         // linear
+    double noise_temperature = 500;     // K, receiver system noise
+    double bandwidth = 20000;           // Hz, receiver noise bandwidth
+};
+
+// Element "counter" of the splitmix64 sequence of stream "key"
+inline uint64_t noise_hash(uint64_t key, uint64_t counter) {
+    uint64_t z = key + counter * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// natural log of x > 0, to about 1e-10
+inline double noise_log(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int32_t e = (int32_t) (bits >> 52) - 1023;
+    bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    // mantissa in [sqrt(1/2), sqrt(2))
+    int32_t above = m > M_SQRT2;
+    m = above ? m * 0.5 : m;
+    e += above;
+    double s = (m - 1) / (m + 1);
+    double s2 = s * s;
+    double series = 1 + s2 * (1.0 / 3 + s2 * (1.0 / 5 + s2 * (1.0 / 7 + s2 * (1.0 / 9 + s2 * (1.0 / 11)))));
+    return e * M_LN2 + 2 * s * series;
+}
+
+// cos(2 * pi * u) for u in [0, 1), to about 1e-9
+inline double noise_cos_2pi(double u) {
+    // half angle y in [-pi / 2, pi / 2), cos(2y) = 1 - 2 sin(y)^2
+    double y = M_PI * (u - 0.5);
+    double y2 = y * y;
+    double sin_y = y * (1 + y2 * (-1.0 / 6 + y2 * (1.0 / 120 + y2 * (-1.0 / 5040 + y2 * (1.0 / 362880
+                   + y2 * (-1.0 / 39916800 + y2 * (1.0 / 6227020800)))))));
+    // cos(2y) = -cos(2 * pi * u), the sign doesn't matter for noise
+    return 1 - 2 * sin_y * sin_y;
+}
+
+// n standard normal samples for counters first .. first + n - 1 of
+// stream "key"
+void gaussian_block(uint64_t key, long first, double *out, int n) {
+    for (int k = 0; k < n; ++k)
+    {
+        uint64_t h = noise_hash(key, first + k);
+        double u1 = ((uint32_t) (h >> 32) + 0.5) * (1.0 / 4294967296.0);  // (0, 1)
+        double u2 = (uint32_t) h * (1.0 / 4294967296.0);                  // [0, 1)
+        out[k] = sqrt(-2 * noise_log(u1)) * noise_cos_2pi(u2);
+    }
+}
+
+class ChannelImpairments {
+
+    int num_sats;
+    double dt;
+    double wavelength;
+    int quarter_period;     // time steps in a quarter carrier period
+    uint64_t seed;
+
+    int awgn = 0;
+    LinkBudget budget;
+    double signal_rms = 1;  // RF rms that budget.tx_power corresponds to
+
+    double phase_step_sigma = 0;    // rad per time step, 0 disables phase noise
+    // random walk state of every link, at [tx * num_sats + rx]
+    vector<double> phase;
+    vector<long> phase_next_step;   // first time step not yet in phase
+
+    static const int chunk_size = 256;
+
+    uint64_t stream_key(int tx, int rx, uint64_t stream) {
+        uint64_t link = (uint64_t) tx * this->num_sats + rx;
+        return this->seed * 0x9e3779b97f4a7c15ULL + link * 0xbf58476d1ce4e5b9ULL + stream * 0x94d049bb133111ebULL;
+    }
+
+public:
+    ChannelImpairments(int num_sats_in, double dt_in, double carrier_frequency, uint64_t seed_in)
+        : phase(num_sats_in * num_sats_in), phase_next_step(num_sats_in * num_sats_in)
+    {
+        this->num_sats = num_sats_in;
+        this->dt = dt_in;
+        this->wavelength = 299792458 / carrier_frequency;
+        this->quarter_period = round(1 / (4 * carrier_frequency * dt_in));
+        this->seed = seed_in;
+    }
+
+    // White Gaussian noise with the SNR of "budget_in". "signal_rms_in"
+    // is the transmitted RF rms that the budget's transmit power
+    // corresponds to.
+    void set_awgn(const LinkBudget &budget_in, double signal_rms_in) {
+        this->awgn = 1;
+        this->budget = budget_in;
+        this->signal_rms = signal_rms_in;
+    }
+
+    // phase noise of an oscillator with "linewidth" (Hz), 0 disables
+    void set_phase_noise(double linewidth) { this->phase_step_sigma = sqrt(2 * M_PI * linewidth * this->dt); }
+
+    int has_awgn() { return this->awgn; }
+    int has_phase_noise() { return this->phase_step_sigma > 0; }
+    int get_quarter_period() { return this->quarter_period; }
+
+    // linear SNR at the receiver for a link of length "distance" (m)
+    double snr(double distance) {
+        double path_gain = this->wavelength / (4 * M_PI * distance);
+        double rx_power = this->budget.tx_power * this->budget.tx_antenna_gain * this->budget.rx_antenna_gain * path_gain * path_gain;
+        return rx_power / (boltzmann_constant * this->budget.noise_temperature * this->budget.bandwidth);
+    }
+
+    // Receiver noise rms, in units of received RF. Received RF is the
+    // transmitted RF times 1 / distance (propagation_loss), so this is
+    // signal_rms / distance / sqrt(snr(distance)) at any distance.
+    double noise_rms() {
+        if (!this->awgn)
+            return 0;
+        double tx_power = this->budget.tx_power * this->budget.tx_antenna_gain * this->budget.rx_antenna_gain;
+        return this->signal_rms * 4 * M_PI / this->wavelength
+            * sqrt(boltzmann_constant * this->budget.noise_temperature * this->budget.bandwidth / tx_power);
+    }
+
+    // Adds the receiver noise of satellite rx at time steps
+    // step .. step + n - 1 to "out"
+    void add_receiver_noise(int rx, long step, double *out, int n) {
+        double noise_sigma = noise_rms();
+        if (noise_sigma == 0)
+            return;
+        double noise[chunk_size];
+        for (int start = 0; start < n; start += chunk_size)
+        {
+            int m = n - start < chunk_size ? n - start : chunk_size;
+            gaussian_block(stream_key(rx, rx, 0), step + start, noise, m);
+            for (int k = 0; k < m; ++k)
+                out[start + k] += noise_sigma * noise[k];
+        }
+    }
+
+    // Adds n samples of link (tx, rx), received at time steps
+    // step .. step + n - 1 with phase noise, to "out". rf holds the
+    // transmitted samples, rf_quadrature the ones a quarter period
+    // earlier (only read with phase noise), "loss" is the propagation
+    // loss of the link and "antenna_gain" the amplitude gain of its
+    // antennas, which only scales the signal (the budget's SNR is for
+    // isotropic antennas). Receiver noise is added by the receiver, see
+    // add_receiver_noise. Time steps of a link must be passed in
+    // increasing order.
+    void add_block(int tx, int rx, long step, const double *rf, const double *rf_quadrature, double loss, double antenna_gain, double *out, int n) {
+        double signal_loss = loss * antenna_gain;
+        double noise[chunk_size];
+        for (int start = 0; start < n; start += chunk_size)
+        {
+            int m = n - start < chunk_size ? n - start : chunk_size;
+            long chunk_step = step + start;
+
+            if (this->phase_step_sigma > 0)
+            {
+                int link = tx * this->num_sats + rx;
+                double &link_phase = this->phase[link];
+                // steps without samples on this link advance the walk
+                // by one increment with their combined spread
+                long skipped = chunk_step - this->phase_next_step[link];
+                if (skipped > 0)
+                {
+                    double increment;
+                    gaussian_block(stream_key(tx, rx, 2), chunk_step, &increment, 1);
+                    link_phase += this->phase_step_sigma * sqrt((double) skipped) * increment;
+                }
+                gaussian_block(stream_key(tx, rx, 1), chunk_step, noise, m);
+                for (int k = 0; k < m; ++k)
+                {
+                    link_phase += this->phase_step_sigma * noise[k];
+                    out[start + k] += (rf[start + k] * cos(link_phase) - rf_quadrature[start + k] * sin(link_phase)) * signal_loss;
+                }
+                link_phase = remainder(link_phase, 2 * M_PI);
+                this->phase_next_step[link] = chunk_step + m;
+            }
+            else
+            {
+                for (int k = 0; k < m; ++k)
+                    out[start + k] += rf[start + k] * signal_loss;
+            }
+        }
+    }
+};
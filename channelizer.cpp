@@ -0,0 +1,132 @@
+#include <vector>
+#include <complex>
+#include <cmath>
+
+using namespace std;
+
+//
+// Polyphase FFT channelizer
+//
+// Splits a real RF stream into num_channels complex baseband
+// channels at once. Channel k is centered at k * (fs / num_channels)
+// and is output at the decimated rate fs / num_channels. The
+// prototype low pass filter is split into num_channels branches
+// (polyphase components), so each input sample is filtered by only
+// one branch, and a single FFT per output block mixes all channels
+// down to baseband. Cost per input sample is taps_per_branch
+// multiply-adds plus log2(num_channels) for the FFT, which barely
+// grows with channel count.
+//
+
+// in place radix-2 FFT. Size of data must be a power of two.
+// Sign of exponent is +1 for inverse transform (no scaling).
+void fft_radix2(vector<complex<double>> &data, int sign)
+{
+    int n = data.size();
+
+    // bit reversal permutation
+    for (int i = 1, j = 0; i < n; ++i)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            swap(data[i], data[j]);
+    }
+
+    // butterflies
+    for (int len = 2; len <= n; len <<= 1)
+    {
+        double angle = sign * 2 * M_PI / len;
+        complex<double> w_len(cos(angle), sin(angle));
+        for (int i = 0; i < n; i += len)
+        {
+            complex<double> w(1, 0);
+            for (int j = 0; j < len / 2; ++j)
+            {
+                complex<double> u = data[i + j];
+                complex<double> v = data[i + j + len / 2] * w;
+                data[i + j] = u + v;
+                data[i + j + len / 2] = u - v;
+                w *= w_len;
+            }
+        }
+    }
+}
+
+class PolyphaseChannelizer {
+
+    int num_channels;           // number of channels, also decimation factor
+    int taps_per_branch;
+    vector<double> prototype;   // prototype low pass filter, num_channels * taps_per_branch taps
+    vector<double> history;     // last num_channels * taps_per_branch input samples (circular)
+    int history_pos = 0;        // index where next input sample is written
+    int samples_in_block = 0;   // input samples received since last output block
+    double dc_gain;             // sum of prototype taps
+    vector<complex<double>> branch_out;
+
+public:
+    PolyphaseChannelizer(int num_channels_in, int taps_per_branch_in = 8)
+    {
+        this->num_channels = num_channels_in;
+        this->taps_per_branch = taps_per_branch_in;
+
+        int num_taps = num_channels_in * taps_per_branch_in;
+        this->prototype.resize(num_taps);
+        this->history.assign(num_taps, 0);
+        this->branch_out.resize(num_channels_in);
+
+        // windowed sinc with cutoff at half the channel spacing
+        // (Hamming window)
+        this->dc_gain = 0;
+        for (int n = 0; n < num_taps; ++n)
+        {
+            double t = n - (num_taps - 1) / 2.0;
+            double x = t / num_channels_in;
+            double sinc = (x == 0) ? 1 : sin(M_PI * x) / (M_PI * x);
+            double window = 0.54 - 0.46 * cos(2 * M_PI * n / (num_taps - 1));
+            this->prototype[n] = sinc * window;
+            this->dc_gain += this->prototype[n];
+        }
+    }
+
+    // Pushes one input sample. Returns 1 once num_channels samples
+    // have been received and a new output block has been written to
+    // "channels_out" (one complex baseband sample per channel),
+    // otherwise returns 0.
+    int push(double sample, vector<complex<double>> &channels_out)
+    {
+        int num_taps = this->num_channels * this->taps_per_branch;
+        this->history[this->history_pos] = sample;
+        this->history_pos = (this->history_pos + 1) % num_taps;
+
+        if (++this->samples_in_block < this->num_channels)
+            return 0;
+        this->samples_in_block = 0;
+
+        // newest sample is at history_pos - 1. Branch p filters the
+        // samples x[n - p - q * num_channels] with taps h[p + q * num_channels].
+        int newest = this->history_pos - 1 + num_taps;
+        for (int p = 0; p < this->num_channels; ++p)
+        {
+            double acc = 0;
+            for (int q = 0; q < this->taps_per_branch; ++q)
+            {
+                int tap = p + q * this->num_channels;
+                acc += this->prototype[tap] * this->history[(newest - tap) % num_taps];
+            }
+            this->branch_out[p] = acc;
+        }
+
+        // one inverse FFT shifts every channel to baseband
+        fft_radix2(this->branch_out, 1);
+
+        channels_out.resize(this->num_channels);
+        for (int k = 0; k < this->num_channels; ++k)
+            channels_out[k] = this->branch_out[k] / this->dc_gain;
+        return 1;
+    }
+
+    int get_num_channels() { return this->num_channels; }
+};
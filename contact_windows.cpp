@@ -0,0 +1,176 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+using namespace std;
+
+//
+// Contact windows between satellites
+//
+// Two satellites can hear each other while the line between them
+// clears the earth (plus a grazing altitude for the atmosphere) and,
+// optionally, they are within a maximum range. That only changes at
+// discrete moments, so ContactPredictor finds the acquisition and loss
+// times of every pair ahead of time with a WindowSearch on the link
+// margin. Satellites are stepped with the orbit the run uses, so the
+// windows hold exactly for the simulated positions. The grid step must
+// be shorter than the shortest contact or gap.
+//
+// The windows are kept in an IntervalTree, so an engine can look up
+// the links that are up during a block in O(log n + k) and skip every
+// other pair.
+//
+// Requires Satellite (satellite.cpp) and WindowSearch
+// (window_search.cpp).
+//
+
+// Static interval tree. Intervals are sorted by start and stored as an
+// implicit balanced binary search tree over the sorted array (the root
+// of a range is its middle element). Every node also keeps the largest
+// end in its subtree, so subtrees ending before a query are skipped.
+template<typename T>
+class IntervalTree {
+
+    struct Interval {
+        double start;
+        double end;
+        T value;
+    };
+
+    vector<Interval> intervals;
+    vector<double> max_end;     // largest end in subtree of each node
+
+    double build(size_t lo, size_t hi) {
+        if (lo >= hi)
+            return -INFINITY;
+        size_t mid = lo + (hi - lo) / 2;
+        double left = build(lo, mid);
+        double right = build(mid + 1, hi);
+        this->max_end[mid] = max(this->intervals[mid].end, max(left, right));
+        return this->max_end[mid];
+    }
+
+    void query(size_t lo, size_t hi, double t0, double t1, vector<T> &out) const {
+        if (lo >= hi)
+            return;
+        size_t mid = lo + (hi - lo) / 2;
+        if (this->max_end[mid] < t0)
+            return;
+        query(lo, mid, t0, t1, out);
+        if (this->intervals[mid].start > t1)
+            return;
+        if (this->intervals[mid].end >= t0)
+            out.push_back(this->intervals[mid].value);
+        query(mid + 1, hi, t0, t1, out);
+    }
+
+public:
+    void insert(double start, double end, const T &value) { this->intervals.push_back({start, end, value}); }
+
+    // call after the last insert and before the first query
+    void build() {
+        sort(this->intervals.begin(), this->intervals.end(), [](const Interval &a, const Interval &b) { return a.start < b.start; });
+        this->max_end.assign(this->intervals.size(), 0);
+        build(0, this->intervals.size());
+    }
+
+    // appends the value of every interval that overlaps [t0, t1]
+    void query(double t0, double t1, vector<T> &out) const { query(0, this->intervals.size(), t0, t1, out); }
+
+    size_t size() const { return this->intervals.size(); }
+};
+
+// time interval in which satellites "sat_a" and "sat_b" (sat_a < sat_b)
+// can hear each other
+struct ContactWindow {
+    int sat_a;
+    int sat_b;
+    double acquire;     // s
+    double loss;        // s
+};
+
+class ContactPredictor {
+
+    vector<Satellite> &satellites;
+    double grazing_radius;  // line of sight must stay this far from the center of the earth
+    double max_range;       // m, 0 means unlimited
+    double dt;              // time step (s)
+
+    // Positive while the link is up. Smallest of the clearance of the
+    // line of sight and the range left.
+    double link_margin(double ax, double ay, double az, double bx, double by, double bz) {
+        double dx = bx - ax, dy = by - ay, dz = bz - az;
+        double dist_sq = dx * dx + dy * dy + dz * dz;
+        // closest point of the line of sight to the center of the earth
+        double u = dist_sq > 0 ? -(ax * dx + ay * dy + az * dz) / dist_sq : 0;
+        u = u < 0 ? 0 : (u > 1 ? 1 : u);
+        double cx = ax + u * dx, cy = ay + u * dy, cz = az + u * dz;
+        double margin = sqrt(cx * cx + cy * cy + cz * cz) - this->grazing_radius;
+        if (this->max_range > 0)
+            margin = min(margin, this->max_range - sqrt(dist_sq));
+        return margin;
+    }
+
+public:
+    ContactPredictor(vector<Satellite> &satellites_in, double grazing_altitude, double max_range_in, double dt_in)
+        : satellites(satellites_in), grazing_radius(earth_radius + grazing_altitude), max_range(max_range_in), dt(dt_in) {}
+
+    // Windows of all pairs within "horizon" seconds from now.
+    // Acquisition and loss are the first and last time step in
+    // contact. Windows open at the start or end of the horizon are cut
+    // off there.
+    vector<ContactWindow> predict(double horizon, double grid_step) {
+        int num_sats = this->satellites.size();
+        vector<MarginPair> pairs;
+        for (int a = 0; a < num_sats; ++a)
+            for (int b = a + 1; b < num_sats; ++b)
+                pairs.push_back({a, b});
+
+        WindowSearch search(this->satellites, pairs, [this, &pairs](int p, long, const vector<OrbitState> &states) {
+            const double *a = states[pairs[p].sat_a].pos;
+            const double *b = states[pairs[p].sat_b].pos;
+            return link_margin(a[0], a[1], a[2], b[0], b[1], b[2]);
+        });
+
+        vector<ContactWindow> windows;
+        for (const MarginWindow &window : search.find(lround(horizon / this->dt), lround(grid_step / this->dt)))
+            windows.push_back({pairs[window.pair].sat_a, pairs[window.pair].sat_b, window.start * this->dt, window.end * this->dt});
+        return windows;
+    }
+};
+
+// Contact windows indexed by time
+class ContactIndex {
+
+    IntervalTree<ContactWindow> tree;
+    int num_sats;
+    mutable vector<ContactWindow> found;
+
+public:
+    ContactIndex(const vector<ContactWindow> &windows, int num_sats_in) {
+        this->num_sats = num_sats_in;
+        for (const ContactWindow &window : windows)
+            this->tree.insert(window.acquire, window.loss, window);
+        this->tree.build();
+    }
+
+    int get_num_windows() const { return this->tree.size(); }
+
+    // Sets linked[a * num_sats + b] (and [b * num_sats + a]) to 1 for
+    // every pair of satellites that is in contact at some time in
+    // [t0, t1], and to 0 otherwise. Returns the number of windows
+    // found.
+    int find_links(double t0, double t1, vector<unsigned char> &linked) const {
+        linked.assign(this->num_sats * this->num_sats, 0);
+        this->found.clear();
+        this->tree.query(t0, t1, this->found);
+        for (const ContactWindow &window : this->found)
+        {
+            linked[window.sat_a * this->num_sats + window.sat_b] = 1;
+            linked[window.sat_b * this->num_sats + window.sat_a] = 1;
+        }
+        return this->found.size();
+    }
+};
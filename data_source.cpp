@@ -2,7 +2,19 @@
 #include <cmath>
 #include <tuple>
 
-class WaveGenerator {
+// source of one audio sample per time step
+class AudioSource {
+public:
+    virtual double get_next() = 0;
+    // skip n samples
+    virtual void skip(long n) {
+        for (long i = 0; i < n; ++i)
+            get_next();
+    }
+    virtual ~AudioSource() = default;
+};
+
+class WaveGenerator : public AudioSource {
     // generates a sample of a sin wave per time step
 
     double dt;
@@ -17,9 +29,11 @@ public:
         this->gain = gain_in;
     }
 
-    double get_next() {
+    double get_next() override {
         double signal = this->gain * sin(2 * M_PI * this->frequency * this->curr_time);
         this->curr_time += this->dt;
         return signal;
     }
+
+    void skip(long n) override { this->curr_time += n * this->dt; }
 };
@@ -1,4 +1,5 @@
 #include <iostream>
+#include "sample_type.cpp"
 
 using namespace std;
 
@@ -6,44 +7,86 @@ using namespace std;
 // In order to reduce memory used, field will
 // only be calculated at points where satellites
 // are located.
-class EMField {
-    
+template<typename T>
+class BasicEMField {
+
     // The field at each receiver will be represented as
     // a vector of fields of all other transmitters
     // So to get the total field at a receiver, a summing
     // opration will be performed.
-    vector<double> field;
+    vector<T> field;
     int num_sats;
+    double scale = 0;   // full scale of fixed point field values
+    // Running total of each receiver's row, updated by the change of
+    // every set_field. Re-summed exactly every resum_interval updates
+    // of the row, so rounding errors of the updates don't build up.
+    vector<double> field_total;
+    vector<int> updates_since_resum;
+    int resum_interval;
+
+    void resum(int rx_sat_id) {
+        double field_sum = 0;
+        for (int i = 0; i < this->num_sats; ++i)
+            field_sum += SampleCodec<T>::decode(this->field[(rx_sat_id * this->num_sats) + i], this->scale);
+        this->field_total[rx_sat_id] = field_sum;
+        this->updates_since_resum[rx_sat_id] = 0;
+    }
+
+    // grows fixed point scale so "field_value" fits
+    void grow_scale(double field_value) {
+        double new_scale = fixed_point_scale_for(field_value);
+        for (size_t i = 0; i < this->field.size(); ++i)
+            this->field[i] = SampleCodec<T>::encode(SampleCodec<T>::decode(this->field[i], this->scale), new_scale);
+        this->scale = new_scale;
+        // every stored value was rounded again
+        for (int rx_sat_id = 0; rx_sat_id < this->num_sats; ++rx_sat_id)
+            resum(rx_sat_id);
+    }
 
 public:
-    EMField(int num_sats_in)
+    BasicEMField(int num_sats_in, int resum_interval_in = 1024)
     {
+        MemoryScope scope(MemorySubsystem::em_field);
         this->field.resize(num_sats_in*num_sats_in);
 
         for (int i = 0; i < (num_sats_in*num_sats_in); ++i)
-            this->field[i] = 0;
+            this->field[i] = SampleCodec<T>::encode(0, this->scale);
         this->num_sats = num_sats_in;
+        this->field_total.assign(num_sats_in, 0);
+        this->updates_since_resum.assign(num_sats_in, 0);
+        this->resum_interval = resum_interval_in;
     }
 
     void set_field (int rx_sat_id, int tx_sat_id, double field_value)
     {
-        this->field[(rx_sat_id * this->num_sats) + tx_sat_id] = field_value;
+        if (SampleCodec<T>::is_fixed && fabs(field_value) > this->scale)
+            grow_scale(field_value);
+        T &entry = this->field[(rx_sat_id * this->num_sats) + tx_sat_id];
+        double old_value = SampleCodec<T>::decode(entry, this->scale);
+        entry = SampleCodec<T>::encode(field_value, this->scale);
         // cout << "Field Value: " << field_value;
         // cout << ", Electric Field Tx: ";
         // for (int i = 0; i < (this->num_sats * this->num_sats); ++i)
         //     cout << this->field[i] << ",";
         // cout << endl;
+
+        // an infinite value would leave the total NaN after it is
+        // replaced, so those rows are re-summed
+        double delta = SampleCodec<T>::decode(entry, this->scale) - old_value;
+        if (++this->updates_since_resum[rx_sat_id] >= this->resum_interval || !isfinite(delta))
+            resum(rx_sat_id);
+        else
+            this->field_total[rx_sat_id] += delta;
     }
 
+    // sum of fields of all transmitters
     double get_field(int rx_sat_id) {
-        // take the sum of fields of all transmitters
-        double field_sum;
-        for (int i = 0; i < this->num_sats; ++i)
-            field_sum += this->field[(rx_sat_id * this->num_sats) + i];
         // cout << "Electric Field Rx";
         // for (int i = 0; i < (this->num_sats * this->num_sats); ++i)
         //     cout << this->field[i] << ",";
         // cout << endl;
-        return field_sum;
+        return this->field_total[rx_sat_id];
     }
 };
+
+using EMField = BasicEMField<rf_sample_t>;
@@ -0,0 +1,291 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+//
+// Chebyshev ephemeris cache
+//
+// A generation pass integrates the orbits once (move_one_frame), splits
+// time into segments of steps_per_segment time steps and fits each
+// coordinate of each satellite per segment with a Chebyshev polynomial
+// (least squares over every time step of the segment). The coefficients
+// are written to a binary file. Later runs memory map the file and
+// evaluate positions at any time with a few multiply-adds (Clenshaw),
+// so sweeps over modulation and DSP parameters never integrate orbits
+// again.
+//
+// File layout: EphemerisHeader, then doubles indexed by
+// [satellite][segment][axis][coefficient].
+//
+
+struct EphemerisHeader {
+    char magic[8];              // "SATEPHM"
+    uint32_t version;
+    uint32_t num_sats;
+    uint32_t num_segments;
+    uint32_t num_coeffs;        // polynomial degree + 1
+    double dt;                  // time step of the generating run
+    double segment_duration;    // seconds
+    double orbit_radius;        // initial orbit radius of the generating run
+    uint64_t seed;              // random seed of the generating run
+};
+
+const char ephemeris_magic[8] = "SATEPHM";
+const uint32_t ephemeris_version = 1;
+
+// Chebyshev polynomials T_0..T_{n-1} at x
+void chebyshev_basis(double x, int n, double *out) {
+    out[0] = 1;
+    if (n > 1)
+        out[1] = x;
+    for (int j = 2; j < n; ++j)
+        out[j] = 2 * x * out[j - 1] - out[j - 2];
+}
+
+// solves a * x = b in place (b becomes x), Gaussian elimination
+// with partial pivoting. a is n x n, row major.
+void solve_linear_system(vector<double> a, double *b, int n) {
+    for (int col = 0; col < n; ++col)
+    {
+        int pivot = col;
+        for (int row = col + 1; row < n; ++row)
+            if (fabs(a[row * n + col]) > fabs(a[pivot * n + col]))
+                pivot = row;
+        if (pivot != col)
+        {
+            for (int k = 0; k < n; ++k)
+                swap(a[col * n + k], a[pivot * n + k]);
+            swap(b[col], b[pivot]);
+        }
+        for (int row = col + 1; row < n; ++row)
+        {
+            double factor = a[row * n + col] / a[col * n + col];
+            for (int k = col; k < n; ++k)
+                a[row * n + k] -= factor * a[col * n + k];
+            b[row] -= factor * b[col];
+        }
+    }
+    for (int row = n - 1; row >= 0; --row)
+    {
+        for (int k = row + 1; k < n; ++k)
+            b[row] -= a[row * n + k] * b[k];
+        b[row] /= a[row * n + row];
+    }
+}
+
+// Fits positions recorded once per time step into Chebyshev segments
+class EphemerisWriter {
+
+    int num_sats;
+    int steps_per_segment;
+    int num_coeffs;
+    int num_recorded = 0;           // samples of the current segment
+    long num_segments = 0;
+    vector<double> basis;           // T_j at each sample of a segment
+    vector<double> normal;          // normal equations of the fit
+    vector<double> samples;         // [sat][axis][sample] of current segment
+    vector<double> coeffs;          // [sat][segment][axis][coeff]
+
+    void fit_segment() {
+        int num_samples = this->steps_per_segment + 1;
+        size_t segment_size = 3 * this->num_coeffs;
+        vector<double> segment(this->num_sats * segment_size);
+
+        for (int s = 0; s < this->num_sats; ++s)
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                double *x = &this->samples[(s * 3 + axis) * num_samples];
+                double *c = &segment[s * segment_size + axis * this->num_coeffs];
+                for (int j = 0; j < this->num_coeffs; ++j)
+                {
+                    c[j] = 0;
+                    for (int i = 0; i < num_samples; ++i)
+                        c[j] += this->basis[i * this->num_coeffs + j] * x[i];
+                }
+                solve_linear_system(this->normal, c, this->num_coeffs);
+
+                // last sample starts the next segment
+                x[0] = x[num_samples - 1];
+            }
+
+        // coefficients are stored segment major while fitting, and
+        // reordered to satellite major in write()
+        this->coeffs.insert(this->coeffs.end(), segment.begin(), segment.end());
+        this->num_segments++;
+        this->num_recorded = 1;
+    }
+
+public:
+    // Each segment spans steps_per_segment time steps and is fitted
+    // with num_coeffs coefficients (degree num_coeffs - 1).
+    EphemerisWriter(int num_sats_in, int steps_per_segment_in, int num_coeffs_in) {
+        this->num_sats = num_sats_in;
+        this->steps_per_segment = steps_per_segment_in;
+        this->num_coeffs = num_coeffs_in;
+
+        // Normal equations are the same for every segment, since samples
+        // are always on the same grid. Only the right hand side changes.
+        int num_samples = steps_per_segment_in + 1;
+        this->basis.resize(num_samples * num_coeffs_in);
+        this->normal.assign(num_coeffs_in * num_coeffs_in, 0);
+        for (int i = 0; i < num_samples; ++i)
+        {
+            double *t = &this->basis[i * num_coeffs_in];
+            chebyshev_basis(2.0 * i / steps_per_segment_in - 1, num_coeffs_in, t);
+            for (int j = 0; j < num_coeffs_in; ++j)
+                for (int k = 0; k < num_coeffs_in; ++k)
+                    this->normal[j * num_coeffs_in + k] += t[j] * t[k];
+        }
+        this->samples.resize(num_sats_in * 3 * num_samples);
+    }
+
+    // call once at time 0 and then after every time step
+    void record(SatellitePositions &sat_pos) {
+        int num_samples = this->steps_per_segment + 1;
+        for (int s = 0; s < this->num_sats; ++s)
+            tie(this->samples[(s * 3 + 0) * num_samples + this->num_recorded],
+                this->samples[(s * 3 + 1) * num_samples + this->num_recorded],
+                this->samples[(s * 3 + 2) * num_samples + this->num_recorded]) = sat_pos.get_position(s);
+        if (++this->num_recorded == num_samples)
+            fit_segment();
+    }
+
+    // 1 once the fitted segments cover num_time_steps
+    int covers(long num_time_steps) { return this->num_segments * this->steps_per_segment >= num_time_steps; }
+
+    // "orbit_radius" and "seed" identify the constellation, so later
+    // runs can check the file matches. Returns 1 on success.
+    int write(const char *path, double dt, double orbit_radius, unsigned seed) {
+        EphemerisHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, ephemeris_magic, sizeof(header.magic));
+        header.version = ephemeris_version;
+        header.num_sats = this->num_sats;
+        header.num_segments = this->num_segments;
+        header.num_coeffs = this->num_coeffs;
+        header.dt = dt;
+        header.segment_duration = this->steps_per_segment * dt;
+        header.orbit_radius = orbit_radius;
+        header.seed = seed;
+
+        // written to a temporary file and renamed, so runs that have
+        // the old file mapped keep a consistent copy
+        string tmp_path = string(path) + ".tmp";
+        ofstream file(tmp_path, ios::binary | ios::trunc);
+        file.write((const char *) &header, sizeof(header));
+        size_t segment_size = 3 * this->num_coeffs;
+        for (int s = 0; s < this->num_sats; ++s)
+            for (long seg = 0; seg < this->num_segments; ++seg)
+                file.write((const char *) &this->coeffs[(seg * this->num_sats + s) * segment_size],
+                           segment_size * sizeof(double));
+        file.close();
+        if (!file)
+            return 0;
+        return rename(tmp_path.c_str(), path) == 0;
+    }
+};
+
+// memory mapped ephemeris file
+class Ephemeris {
+
+    void *mapping = NULL;
+    size_t mapping_size = 0;
+    const EphemerisHeader *header = NULL;
+    const double *coeffs = NULL;
+    long num_segments = 0;
+    int num_coeffs = 0;
+    double inv_segment_duration = 0;
+
+public:
+    Ephemeris(const char *path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && (size_t) file_stat.st_size >= sizeof(EphemerisHeader))
+        {
+            void *addr = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                this->mapping = addr;
+                this->mapping_size = file_stat.st_size;
+            }
+        }
+        close(fd);
+        if (this->mapping == NULL)
+            return;
+
+        const EphemerisHeader *h = (const EphemerisHeader *) this->mapping;
+        size_t expected = sizeof(EphemerisHeader)
+            + (size_t) h->num_sats * h->num_segments * 3 * h->num_coeffs * sizeof(double);
+        if (memcmp(h->magic, ephemeris_magic, sizeof(h->magic)) != 0 || h->version != ephemeris_version
+            || this->mapping_size < expected)
+            return;
+        this->header = h;
+        this->coeffs = (const double *) ((const char *) this->mapping + sizeof(EphemerisHeader));
+        this->num_segments = h->num_segments;
+        this->num_coeffs = h->num_coeffs;
+        this->inv_segment_duration = 1 / h->segment_duration;
+    }
+
+    int is_valid() { return this->header != NULL; }
+
+    // 1 if the file was generated for this constellation and covers
+    // num_time_steps
+    int matches(int num_sats, double dt, double orbit_radius, unsigned seed, long num_time_steps) {
+        return is_valid() && this->header->num_sats == (uint32_t) num_sats && this->header->dt == dt
+            && this->header->orbit_radius == orbit_radius && this->header->seed == seed
+            && this->header->num_segments * this->header->segment_duration >= num_time_steps * dt;
+    }
+
+    // position of satellite sat_id at time t (seconds since start)
+    tuple<double, double, double> get_position(int sat_id, double t) {
+        double segment_time = t * this->inv_segment_duration;
+        long seg = (long) segment_time;
+        if (seg >= this->num_segments)
+            seg = this->num_segments - 1;
+        if (seg < 0)
+            seg = 0;
+        // map segment to [-1, 1]
+        double x = 2 * (segment_time - seg) - 1;
+        int n = this->num_coeffs;
+        const double *c = this->coeffs + (sat_id * this->num_segments + seg) * 3 * n;
+
+        // Clenshaw recurrence, all three axes at once
+        const double *cx = c;
+        const double *cy = c + n;
+        const double *cz = c + 2 * n;
+        double x2 = 2 * x;
+        double bx1 = 0, by1 = 0, bz1 = 0;
+        double bx2 = 0, by2 = 0, bz2 = 0;
+        for (int j = n - 1; j >= 1; --j)
+        {
+            double bx0 = x2 * bx1 - bx2 + cx[j];
+            double by0 = x2 * by1 - by2 + cy[j];
+            double bz0 = x2 * bz1 - bz2 + cz[j];
+            bx2 = bx1;
+            by2 = by1;
+            bz2 = bz1;
+            bx1 = bx0;
+            by1 = by0;
+            bz1 = bz0;
+        }
+        return tuple<double, double, double>{x * bx1 - bx2 + cx[0], x * by1 - by2 + cy[0], x * bz1 - bz2 + cz[0]};
+    }
+
+    ~Ephemeris() {
+        if (this->mapping != NULL)
+            munmap(this->mapping, this->mapping_size);
+    }
+};
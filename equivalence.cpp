@@ -0,0 +1,260 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+//
+// Reference versus fast path equivalence harness
+//
+// Runs one scenario twice from the same random seed: once through the
+// reference per sample path (same order of operations as the loop in
+// main) and once through a fast engine. The tx/rx audio, tx/rx RF and
+// satellite position streams are then compared sample by sample. A
+// sample passes if |fast - reference| <= abs_tol + rel_tol * |reference|.
+// NaN / Inf samples always fail, so a scenario whose reference diverges
+// can't pass. For each stream the report gives the number of failing samples, the
+// first step that diverges and the largest error.
+//
+// Requires the engines (pipeline.cpp, block_relay.cpp, tiled.cpp) and
+// SimulationTrace (trace.cpp).
+//
+
+enum class FastPath { pipeline, block_relay, tiled };
+
+// parameters of a simulation run. Satellite 0 transmits, the last
+// satellite receives and the rest relay.
+struct Scenario {
+    string modulation = "AM";
+    int num_satellites = 2;
+    double frequency = 25000;
+    double time_step = 1 / (25000.0 * 16);
+    double audio_tone_frequency = 800;
+    double gain = 10000;
+    double orbit_radius = 8357000;
+    unsigned seed = 7;
+    long num_time_steps = 10;
+    int block_size = 256;
+};
+
+unique_ptr<AbstractSigProcFactory> make_sig_proc_factory(const string &modulation) {
+    if (modulation == "FM")
+        return make_unique<FMProcessingFactory>();
+    if (modulation == "BPSK")
+        return make_unique<BPSKProcessingFactory>();
+    if (modulation == "QPSK")
+        return make_unique<QPSKProcessingFactory>();
+    return make_unique<AMProcessingFactory>();
+}
+
+// Owns every object of one run of a scenario
+class ScenarioInstance {
+public:
+    unique_ptr<AbstractSigProcFactory> sig_proc_factory;
+    SatellitePositions sat_pos;
+    EMField em_field;
+    vector<Satellite> satellites;
+    WaveGenerator wave_gen;
+
+    // satellite i uses modulations[i] if given and not empty, the
+    // scenario's modulation otherwise. Orbits don't depend on it.
+    ScenarioInstance(const Scenario &scenario, const vector<string> &modulations = {})
+        : sat_pos(scenario.num_satellites), em_field(scenario.num_satellites),
+          wave_gen(scenario.audio_tone_frequency, scenario.time_step, scenario.gain)
+    {
+        sig_proc_factory = make_sig_proc_factory(scenario.modulation);
+
+        srand(scenario.seed);
+        MemoryScope scope(MemorySubsystem::satellites);
+        satellites.reserve(scenario.num_satellites);
+        for (int i = 0; i < scenario.num_satellites; ++i)
+        {
+            int own_modulation = i < (int) modulations.size() && !modulations[i].empty();
+            unique_ptr<AbstractSigProcFactory> factory = own_modulation ? make_sig_proc_factory(modulations[i]) : NULL;
+            satellites.emplace_back(i, own_modulation ? factory : sig_proc_factory, &sat_pos, &em_field,
+                scenario.time_step, scenario.frequency, scenario.orbit_radius);
+        }
+    }
+};
+
+// per sample path, in the same order as the loop in main
+void run_reference(ScenarioInstance &sim, long num_time_steps, SimulationTrace &trace) {
+    int num_sats = sim.satellites.size();
+    int rx_sat = num_sats - 1;
+    vector<double> positions(3 * num_sats);
+
+    for (long i = 0; i < num_time_steps; ++i)
+    {
+        double audio_in = sim.wave_gen.get_next();
+        sim.satellites[0].move_one_frame();
+        sim.satellites[0].transmit_signal(audio_in);
+        for (int j = 1; j < rx_sat; ++j)
+        {
+            sim.satellites[j].move_one_frame();
+            sim.satellites[j].retransmit();
+        }
+        sim.satellites[rx_sat].move_one_frame();
+        double audio_out = sim.satellites[rx_sat].receive_signal(0);
+
+        trace.record_step(audio_in, sim.satellites[0].get_last_processed_tx_sample(),
+            sim.satellites[rx_sat].get_last_received_rf_sample(), audio_out);
+        for (int s = 0; s < num_sats; ++s)
+            tie(positions[3 * s], positions[3 * s + 1], positions[3 * s + 2]) = sim.sat_pos.get_position(s);
+        trace.record_positions(positions.data(), num_sats);
+    }
+}
+
+struct ToleranceBounds {
+    double abs_tol;
+    double rel_tol;
+};
+
+struct EquivalenceBounds {
+    ToleranceBounds audio = {1e-9, 1e-6};
+    ToleranceBounds rf = {1e-12, 1e-6};
+    ToleranceBounds position = {1e-6, 1e-9};
+};
+
+struct StreamReport {
+    string name;
+    long num_compared = 0;
+    long num_failed = 0;
+    long first_failure = -1;        // time step
+    double first_reference = 0;
+    double first_fast = 0;
+    double max_error = 0;
+    long max_error_step = -1;
+    long num_non_finite = 0;        // NaN / Inf samples in the reference
+};
+
+// values_per_step is the number of entries per time step in the
+// streams (3 * number of satellites for positions)
+StreamReport compare_stream(const string &name, const vector<double> &reference, const vector<double> &fast,
+                            ToleranceBounds bounds, int values_per_step = 1) {
+    StreamReport report;
+    report.name = name;
+    size_t n = reference.size() < fast.size() ? reference.size() : fast.size();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        double error = fabs(fast[i] - reference[i]);
+        // a NaN / Inf sample is a failure even if both streams have
+        // it: the reference diverged and proves nothing
+        int non_finite = !isfinite(reference[i]) || !isfinite(fast[i]);
+        int failed = non_finite || error > bounds.abs_tol + bounds.rel_tol * fabs(reference[i]);
+        report.num_compared++;
+        report.num_non_finite += !isfinite(reference[i]);
+
+        if (!isnan(error) && error > report.max_error)
+        {
+            report.max_error = error;
+            report.max_error_step = i / values_per_step;
+        }
+        if (!failed)
+            continue;
+        if (report.num_failed++ == 0)
+        {
+            report.first_failure = i / values_per_step;
+            report.first_reference = reference[i];
+            report.first_fast = fast[i];
+        }
+    }
+
+    // a stream that is shorter than the other one diverges at its end
+    if (reference.size() != fast.size() && report.first_failure < 0)
+        report.first_failure = n / values_per_step;
+    return report;
+}
+
+// streambuf that discards output
+class NullStreamBuf : public streambuf
+{
+public:
+    virtual int overflow(int outputVal) override { return outputVal; }
+};
+
+class EquivalenceHarness {
+
+    Scenario scenario;
+    EquivalenceBounds bounds;
+    vector<StreamReport> reports;
+
+public:
+    EquivalenceHarness(const Scenario &scenario_in, const EquivalenceBounds &bounds_in = EquivalenceBounds())
+        : scenario(scenario_in), bounds(bounds_in) {}
+
+    // Runs the scenario through the reference path and "fast_path",
+    // prints a report to "ins". Returns 1 if every stream is within
+    // bounds.
+    int run(FastPath fast_path, ostream &ins) {
+        SimulationTrace reference_trace;
+        SimulationTrace fast_trace;
+
+        ScenarioInstance reference_sim(this->scenario);
+        run_reference(reference_sim, this->scenario.num_time_steps, reference_trace);
+
+        // fast engines print every step, which is not needed here
+        NullStreamBuf null_buf;
+        ostream null_stream(&null_buf);
+        IndentStream null_ins(null_stream);
+
+        ScenarioInstance fast_sim(this->scenario);
+        if (fast_path == FastPath::pipeline)
+        {
+            PipelinedEngine pipeline(fast_sim.satellites, &fast_sim.sat_pos, fast_sim.wave_gen, this->scenario.block_size);
+            pipeline.set_trace(&fast_trace);
+            pipeline.run(this->scenario.num_time_steps, null_ins);
+        }
+        else if (fast_path == FastPath::tiled)
+        {
+            TiledEngine tiled(fast_sim.satellites, fast_sim.wave_gen, this->scenario.time_step, this->scenario.block_size, 2);
+            tiled.set_trace(&fast_trace);
+            tiled.run(this->scenario.num_time_steps, null_ins);
+        }
+        else
+        {
+            BlockRelayEngine block_relay(fast_sim.satellites, fast_sim.wave_gen, this->scenario.block_size);
+            block_relay.set_trace(&fast_trace);
+            block_relay.run(this->scenario.num_time_steps, null_ins);
+        }
+
+        int num_sats = this->scenario.num_satellites;
+        this->reports.clear();
+        this->reports.push_back(compare_stream("Tx Audio", reference_trace.tx_audio, fast_trace.tx_audio, this->bounds.audio));
+        this->reports.push_back(compare_stream("Tx RF", reference_trace.tx_rf, fast_trace.tx_rf, this->bounds.rf));
+        this->reports.push_back(compare_stream("Rx RF", reference_trace.rx_rf, fast_trace.rx_rf, this->bounds.rf));
+        this->reports.push_back(compare_stream("Rx Audio", reference_trace.rx_audio, fast_trace.rx_audio, this->bounds.audio));
+        this->reports.push_back(compare_stream("Positions", reference_trace.positions, fast_trace.positions, this->bounds.position, 3 * num_sats));
+
+        int all_passed = 1;
+        const char *fast_path_name = fast_path == FastPath::pipeline ? "pipeline" : (fast_path == FastPath::tiled ? "tiled" : "block relay");
+        ins << "Equivalence Report (" << fast_path_name
+            << ", " << this->scenario.num_time_steps << " time steps):" << indent << endl;
+        for (StreamReport &report : this->reports)
+        {
+            ins << report.name << ": " << (report.first_failure < 0 ? "PASS" : "FAIL") << indent << endl;
+            ins << "Samples Compared: " << report.num_compared
+                << ", Failed: " << report.num_failed << endl;
+            if (report.num_non_finite > 0)
+                ins << "Reference Not Finite: " << report.num_non_finite << " samples, scenario is invalid" << endl;
+            ins << "Max Error: " << report.max_error;
+            if (report.max_error_step >= 0)
+                ins << " at Time Step: " << report.max_error_step;
+            ins << endl;
+            if (report.first_failure >= 0)
+            {
+                all_passed = 0;
+                ins << "First Divergence at Time Step: " << report.first_failure
+                    << ", Reference: " << report.first_reference
+                    << ", Fast: " << report.first_fast << endl;
+            }
+            ins << unindent;
+        }
+        ins << unindent;
+        return all_passed;
+    }
+
+    const vector<StreamReport> &get_reports() { return this->reports; }
+};
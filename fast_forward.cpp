@@ -0,0 +1,133 @@
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//
+// Duty cycled simulation with fast forward over silence
+//
+// The tx satellite only transmits during scheduled bursts. Relays are
+// squelched so they transmit silence while they receive nothing. When
+// no burst is active and every delay line has drained (everything sent
+// has passed every satellite), nothing can change any receiver until
+// the next burst. The engine then jumps straight to the next burst:
+// orbits are advanced analytically in one step, and signal processors,
+// delay lines and the audio source skip ahead, instead of paying for
+// every silent RF step.
+//
+// Satellite 0 transmits, the last one receives and the rest relay, as
+// in main. Requires Satellite (satellite.cpp), AudioSource
+// (data_source.cpp) and WavFileSink (audio_file.cpp).
+//
+
+// periodic transmission bursts, in time steps
+class TransmitSchedule {
+    long period;    // 0 means always transmitting
+    long burst;     // length of each burst
+    long offset;    // start of first burst
+
+public:
+    TransmitSchedule(long period_in, long burst_in, long offset_in = 0) {
+        this->period = period_in;
+        this->burst = burst_in;
+        this->offset = offset_in;
+    }
+
+    int is_active(long step) {
+        if (this->period <= 0)
+            return 1;
+        if (step < this->offset)
+            return 0;
+        return (step - this->offset) % this->period < this->burst;
+    }
+
+    // first step of the next burst at or after "step"
+    long next_start(long step) {
+        if (this->period <= 0 || step <= this->offset)
+            return step > this->offset ? step : this->offset;
+        long num_periods = (step - this->offset + this->period - 1) / this->period;
+        return this->offset + num_periods * this->period;
+    }
+};
+
+class FastForwardEngine {
+
+    vector<Satellite> &satellites;
+    AudioSource &audio_source;
+    TransmitSchedule schedule;
+    WavFileSink *audio_sink = NULL;     // optional, gets received audio
+    long skipped_steps = 0;
+
+    // no burst is active and nothing sent can still reach a receiver
+    int is_quiet(long step) {
+        if (this->schedule.is_active(step))
+            return 0;
+        for (size_t s = 0; s + 1 < this->satellites.size(); ++s)
+            if (!this->satellites[s].is_drained())
+                return 0;
+        return 1;
+    }
+
+public:
+    // relays transmit silence while their received RF is at or below
+    // "relay_squelch"
+    FastForwardEngine(vector<Satellite> &satellites_in, AudioSource &audio_source_in, TransmitSchedule schedule_in, double relay_squelch = 1e-20)
+        : satellites(satellites_in), audio_source(audio_source_in), schedule(schedule_in)
+    {
+        for (size_t j = 1; j + 1 < satellites_in.size(); ++j)
+            this->satellites[j].set_relay_squelch(relay_squelch);
+    }
+
+    void set_audio_sink(WavFileSink *audio_sink_in) { this->audio_sink = audio_sink_in; }
+
+    long get_skipped_steps() { return this->skipped_steps; }
+
+    void run(long num_time_steps, ostream &ins) {
+        int tx_sat = 0;
+        int rx_sat = this->satellites.size() - 1;
+
+        for (long step = 0; step < num_time_steps; )
+        {
+            if (is_quiet(step))
+            {
+                long next = this->schedule.next_start(step);
+                long skip = (next < num_time_steps ? next : num_time_steps) - step;
+                for (Satellite &satellite : this->satellites)
+                    satellite.skip_time(skip);
+                this->audio_source.skip(skip);
+                if (this->audio_sink != NULL)
+                    this->audio_sink->write_silence(skip);
+
+                ins << "Fast Forward: " << skip << " time steps from Time Step: " << step << endl;
+                this->skipped_steps += skip;
+                step += skip;
+                continue;
+            }
+
+            double audio_signal = this->audio_source.get_next();
+            this->satellites[tx_sat].move_one_frame();
+            if (this->schedule.is_active(step))
+                this->satellites[tx_sat].transmit_signal(audio_signal);
+            else
+                this->satellites[tx_sat].transmit_silence();
+
+            for (int j = 1; j < rx_sat; ++j)
+            {
+                this->satellites[j].move_one_frame();
+                this->satellites[j].retransmit();
+            }
+
+            this->satellites[rx_sat].move_one_frame();
+            double received = this->satellites[rx_sat].receive_signal(0);
+            if (this->audio_sink != NULL)
+                this->audio_sink->write(received);
+
+            ins << "Time Step: " << step << indent << endl;
+            ins << "Transmitted Audio Sample: " << audio_signal << endl;
+            ins << "Transmitted RF Sample: " << this->satellites[tx_sat].get_last_processed_tx_sample() << endl;
+            ins << "Received RF Sample: " << this->satellites[rx_sat].get_last_received_rf_sample() << endl;
+            ins << "Received Audio Sample: " << received << unindent << endl;
+            ++step;
+        }
+    }
+};
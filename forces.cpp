@@ -0,0 +1,236 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <tuple>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+//
+// Force models
+//
+// Every force term is a policy class with
+//     void prepare(double t)
+//         called once per time step, for work that doesn't depend on
+//         the satellite (e.g. where the moon is)
+//     void add_acceleration(x, y, z, vx, vy, vz, ax, ay, az) const
+//         adds the term's acceleration (m/s^2) for one satellite
+// ForceModel<Terms...> sums the terms with a fold expression, so the
+// whole model is inlined into one kernel without runtime dispatch.
+// ConstellationPropagator<Model> keeps the state of every satellite in
+// flat arrays and advances the whole constellation in one loop, which
+// the compiler vectorizes at -O3 -march=native -fno-math-errno.
+//
+// Requires Satellite (satellite.cpp).
+//
+
+double constexpr earth_equatorial_radius = 6378137;     // m
+double constexpr earth_j2 = 1.08262668e-3;
+double constexpr obliquity_of_ecliptic = 23.439 * M_PI / 180;
+
+struct PointMassGravity {
+    void prepare(double) {}
+
+    void add_acceleration(double x, double y, double z, double, double, double, double &ax, double &ay, double &az) const {
+        double r_sq = x * x + y * y + z * z;
+        double g = -G_M_Earth / (r_sq * sqrt(r_sq));
+        ax += g * x;
+        ay += g * y;
+        az += g * z;
+    }
+};
+
+// oblateness of the earth, second zonal harmonic
+struct J2Oblateness {
+    void prepare(double) {}
+
+    void add_acceleration(double x, double y, double z, double, double, double, double &ax, double &ay, double &az) const {
+        double r_sq = x * x + y * y + z * z;
+        double r5 = r_sq * r_sq * sqrt(r_sq);
+        double k = -1.5 * earth_j2 * G_M_Earth * earth_equatorial_radius * earth_equatorial_radius / r5;
+        double z_term = 5 * z * z / r_sq;
+        ax += k * x * (1 - z_term);
+        ay += k * y * (1 - z_term);
+        az += k * z * (3 - z_term);
+    }
+};
+
+// exp(x) for x clamped to [-700, 700], to about 1e-13 relative.
+// Branch free, so the propagator loop vectorizes without -ffast-math.
+inline double drag_exp(double x) {
+    x = x < -700 ? -700 : (x > 700 ? 700 : x);
+    // x = k ln 2 + r, |r| <= ln 2 / 2
+    double k = nearbyint(x * M_LOG2E);
+    double r = x - k * M_LN2;
+    double p = 1 + r * (1 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 + r * (1.0 / 720
+               + r * (1.0 / 5040 + r * (1.0 / 40320 + r * (1.0 / 362880 + r * (1.0 / 3628800 + r * (1.0 / 39916800)))))))))));
+    uint64_t bits = (uint64_t) ((int64_t) k + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+// Drag in an exponential atmosphere that rotates with the earth.
+// Default density profile is fitted around 700 km altitude.
+struct ExponentialDrag {
+    double area_to_mass = 0.022;            // drag coefficient * area / mass, m^2/kg
+    double reference_density = 3.614e-13;   // kg/m^3
+    double reference_altitude = 700000;     // m
+    double scale_height = 88667;            // m
+
+    void prepare(double) {}
+
+    void add_acceleration(double x, double y, double z, double vx, double vy, double vz, double &ax, double &ay, double &az) const {
+        double altitude = sqrt(x * x + y * y + z * z) - earth_radius;
+        double density = this->reference_density * drag_exp((this->reference_altitude - altitude) / this->scale_height);
+        // velocity relative to the atmosphere
+        double rel_x = vx + earth_rotation_rate * y;
+        double rel_y = vy - earth_rotation_rate * x;
+        double rel_z = vz;
+        double k = -0.5 * this->area_to_mass * density * sqrt(rel_x * rel_x + rel_y * rel_y + rel_z * rel_z);
+        ax += k * rel_x;
+        ay += k * rel_y;
+        az += k * rel_z;
+    }
+};
+
+// Bodies for ThirdBodyGravity, on circular orbits around the earth
+// in the ecliptic
+struct Moon {
+    static constexpr double gravitational_parameter = 4.9048695e12;    // m^3/s^2
+    static constexpr double distance = 384400000;                       // m
+    static constexpr double period = 27.321661 * 86400;                 // s
+    static constexpr double inclination = obliquity_of_ecliptic + 5.145 * M_PI / 180;
+};
+
+struct Sun {
+    static constexpr double gravitational_parameter = 1.32712440018e20;
+    static constexpr double distance = 1.495978707e11;
+    static constexpr double period = 365.256363 * 86400;
+    static constexpr double inclination = obliquity_of_ecliptic;
+};
+
+// Tidal acceleration of "Body": its pull on the satellite minus its
+// pull on the earth
+template<typename Body>
+struct ThirdBodyGravity {
+    double phase = 0;       // angle along the orbit at time 0, rad
+    double body_x = 0, body_y = 0, body_z = 0;
+    double earth_x = 0, earth_y = 0, earth_z = 0;   // pull on the earth
+
+    void prepare(double t) {
+        double angle = this->phase + 2 * M_PI * t / Body::period;
+        this->body_x = Body::distance * cos(angle);
+        this->body_y = Body::distance * sin(angle) * cos(Body::inclination);
+        this->body_z = Body::distance * sin(angle) * sin(Body::inclination);
+        double g = Body::gravitational_parameter / (Body::distance * Body::distance * Body::distance);
+        this->earth_x = g * this->body_x;
+        this->earth_y = g * this->body_y;
+        this->earth_z = g * this->body_z;
+    }
+
+    void add_acceleration(double x, double y, double z, double, double, double, double &ax, double &ay, double &az) const {
+        double dx = this->body_x - x, dy = this->body_y - y, dz = this->body_z - z;
+        double d_sq = dx * dx + dy * dy + dz * dz;
+        double g = Body::gravitational_parameter / (d_sq * sqrt(d_sq));
+        ax += g * dx - this->earth_x;
+        ay += g * dy - this->earth_y;
+        az += g * dz - this->earth_z;
+    }
+};
+
+template<typename... Terms>
+class ForceModel : public Terms... {
+public:
+    void prepare(double t) { (Terms::prepare(t), ...); }
+
+    void acceleration(double x, double y, double z, double vx, double vy, double vz, double &ax, double &ay, double &az) const {
+        ax = 0;
+        ay = 0;
+        az = 0;
+        (Terms::add_acceleration(x, y, z, vx, vy, vz, ax, ay, az), ...);
+    }
+
+    // a term of the model, to set its parameters
+    template<typename Term>
+    Term &get() { return *this; }
+};
+
+using TwoBodyForceModel = ForceModel<PointMassGravity>;
+using LeoForceModel = ForceModel<PointMassGravity, J2Oblateness, ExponentialDrag, ThirdBodyGravity<Moon>, ThirdBodyGravity<Sun>>;
+
+// Advances all satellites with velocity Verlet. Satellites are switched
+// to external orbits: their move_one_frame does nothing and step()
+// writes their new positions and velocities instead.
+template<typename Model>
+class ConstellationPropagator {
+
+    vector<Satellite> &satellites;
+    SatellitePositions *sat_positions;
+    Model model;
+    double dt;
+    double time = 0;
+    int num_sats;
+    vector<double> x, y, z, vx, vy, vz, ax, ay, az;
+
+    // One velocity Verlet step of n satellites. The state arrays must
+    // not overlap (__restrict lets the compiler vectorize without
+    // checking that at run time).
+    static void verlet_step(const Model &model, double h, int n,
+                            double *__restrict x, double *__restrict y, double *__restrict z,
+                            double *__restrict vx, double *__restrict vy, double *__restrict vz,
+                            double *__restrict ax, double *__restrict ay, double *__restrict az) {
+        for (int s = 0; s < n; ++s)
+        {
+            x[s] += h * (vx[s] + 0.5 * h * ax[s]);
+            y[s] += h * (vy[s] + 0.5 * h * ay[s]);
+            z[s] += h * (vz[s] + 0.5 * h * az[s]);
+            // velocity dependent terms see the velocity predicted with
+            // the old acceleration
+            double new_ax, new_ay, new_az;
+            model.acceleration(x[s], y[s], z[s], vx[s] + h * ax[s], vy[s] + h * ay[s], vz[s] + h * az[s], new_ax, new_ay, new_az);
+            vx[s] += 0.5 * h * (ax[s] + new_ax);
+            vy[s] += 0.5 * h * (ay[s] + new_ay);
+            vz[s] += 0.5 * h * (az[s] + new_az);
+            ax[s] = new_ax;
+            ay[s] = new_ay;
+            az[s] = new_az;
+        }
+    }
+
+public:
+    ConstellationPropagator(vector<Satellite> &satellites_in, SatellitePositions *sat_positions_in, double dt_in, const Model &model_in = Model())
+        : satellites(satellites_in), sat_positions(sat_positions_in), model(model_in)
+    {
+        this->dt = dt_in;
+        this->num_sats = satellites_in.size();
+        for (vector<double> *v : {&this->x, &this->y, &this->z, &this->vx, &this->vy, &this->vz, &this->ax, &this->ay, &this->az})
+            v->resize(this->num_sats);
+        for (int s = 0; s < this->num_sats; ++s)
+        {
+            tie(this->x[s], this->y[s], this->z[s]) = this->satellites[s].get_cartesian_position();
+            tie(this->vx[s], this->vy[s], this->vz[s]) = this->satellites[s].get_velocity();
+            this->satellites[s].set_external_orbit(1);
+        }
+        this->model.prepare(this->time);
+        for (int s = 0; s < this->num_sats; ++s)
+            this->model.acceleration(this->x[s], this->y[s], this->z[s], this->vx[s], this->vy[s], this->vz[s], this->ax[s], this->ay[s], this->az[s]);
+    }
+
+    // advances every satellite by one time step
+    void step() {
+        this->time += this->dt;
+        this->model.prepare(this->time);
+        verlet_step(this->model, this->dt, this->num_sats, this->x.data(), this->y.data(), this->z.data(),
+                    this->vx.data(), this->vy.data(), this->vz.data(), this->ax.data(), this->ay.data(), this->az.data());
+        for (int s = 0; s < this->num_sats; ++s)
+        {
+            this->sat_positions->set_position(s, this->x[s], this->y[s], this->z[s]);
+            this->satellites[s].set_velocity(this->vx[s], this->vy[s], this->vz[s]);
+        }
+    }
+
+    Model &get_model() { return this->model; }
+    double get_time() { return this->time; }
+};
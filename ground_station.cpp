@@ -0,0 +1,196 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+using namespace std;
+
+//
+// Ground stations and pass prediction
+//
+// Ground stations are fixed to the earth, which rotates about the z
+// axis of the simulation frame. A station only hears a satellite while
+// it is above the station's elevation mask.
+//
+// Before the simulation starts, PassPredictor finds the rise and set
+// times of every station / satellite pair with a WindowSearch on
+// (elevation - mask). Satellites are stepped with the orbit the run
+// uses, so the windows hold exactly for the simulated positions.
+// Orbits set from outside, e.g. by a ConstellationPropagator, can't be
+// predicted. The grid step must be shorter than the shortest pass.
+//
+// GroundSegment then only evaluates links inside these visibility
+// windows, and demodulates all stations at once in a ReceiverBank.
+// Modulations the bank doesn't support (BPSK, QPSK) are demodulated by
+// one rx processor per station instead.
+//
+// Requires Satellite (satellite.cpp), WindowSearch (window_search.cpp)
+// and ReceiverBank (receiver_bank.cpp).
+//
+
+struct GroundStation {
+    double latitude;        // radians
+    double longitude;       // radians, at time 0
+    double altitude;        // m
+    double min_elevation;   // radians, elevation mask
+
+    // (x, y, z) position at time t (s)
+    tuple<double, double, double> get_position(double t) const {
+        double r = earth_radius + this->altitude;
+        double lon = this->longitude + earth_rotation_rate * t;
+        return make_tuple(r * cos(this->latitude) * cos(lon), r * cos(this->latitude) * sin(lon), r * sin(this->latitude));
+    }
+
+    // sin(elevation) - sin(min_elevation) of a satellite at
+    // (x, y, z) at time t. Positive while the satellite is in view.
+    double elevation_margin(double t, double x, double y, double z) const {
+        double gx, gy, gz;
+        tie(gx, gy, gz) = get_position(t);
+        double r = earth_radius + this->altitude;
+        double los_x = x - gx, los_y = y - gy, los_z = z - gz;
+        double los = sqrt(los_x * los_x + los_y * los_y + los_z * los_z);
+        return (los_x * gx + los_y * gy + los_z * gz) / (r * los) - sin(this->min_elevation);
+    }
+};
+
+// time interval in which satellite "sat" is above the mask of
+// ground station "station"
+struct VisibilityWindow {
+    int station;
+    int sat;
+    double rise;    // s
+    double set;     // s
+};
+
+class PassPredictor {
+
+    vector<GroundStation> &stations;
+    vector<Satellite> &satellites;
+    double dt;              // time step (s)
+
+public:
+    PassPredictor(vector<GroundStation> &stations_in, vector<Satellite> &satellites_in, double dt_in)
+        : stations(stations_in), satellites(satellites_in), dt(dt_in) {}
+
+    // Windows of all pairs within "horizon" seconds from now, sorted
+    // by rise time. Rise and set are the first and last time step in
+    // view. Windows open at the start or end of the horizon are cut
+    // off there.
+    vector<VisibilityWindow> predict(double horizon, double grid_step) {
+        int num_sats = this->satellites.size();
+
+        // pair p is station p / num_sats and satellite p % num_sats
+        vector<MarginPair> pairs;
+        for (size_t g = 0; g < this->stations.size(); ++g)
+            for (int s = 0; s < num_sats; ++s)
+                pairs.push_back({s, -1});
+
+        WindowSearch search(this->satellites, pairs, [this, num_sats](int p, long step, const vector<OrbitState> &states) {
+            const OrbitState &state = states[p % num_sats];
+            return this->stations[p / num_sats].elevation_margin(step * this->dt, state.pos[0], state.pos[1], state.pos[2]);
+        });
+
+        vector<VisibilityWindow> windows;
+        for (const MarginWindow &window : search.find(lround(horizon / this->dt), lround(grid_step / this->dt)))
+            windows.push_back({window.pair / num_sats, window.pair % num_sats, window.start * this->dt, window.end * this->dt});
+
+        sort(windows.begin(), windows.end(), [](const VisibilityWindow &a, const VisibilityWindow &b) { return a.rise < b.rise; });
+        return windows;
+    }
+};
+
+class GroundSegment {
+
+    vector<GroundStation> stations;
+    vector<VisibilityWindow> windows;   // sorted by rise time
+    size_t next_window = 0;             // first window that hasn't risen
+    vector<VisibilityWindow> active;    // windows open at the current time
+
+    // one bank lane per station, or one processor per station if the
+    // bank doesn't support the modulation
+    ReceiverBank receiver_bank;
+    vector<unique_ptr<RxProcessing>> rx_processors;
+    vector<double> rf;
+    vector<unsigned char> in_view;
+    vector<dsp_sample_t> audio;
+
+public:
+    // Every station gets a receiver made by "sig_proc_factory"
+    GroundSegment(const vector<GroundStation> &stations_in, unique_ptr<AbstractSigProcFactory> &sig_proc_factory, double frequency, double dt)
+        : stations(stations_in), rf(stations_in.size()), in_view(stations_in.size()), audio(stations_in.size())
+    {
+        AddReceiverBankLane add_lane(this->receiver_bank);
+        for (size_t g = 0; g < this->stations.size(); ++g)
+        {
+            unique_ptr<RxProcessing> rx_processor = sig_proc_factory->create<RxProcessing>();
+            rx_processor->set_parameters(frequency, dt);
+            // all stations use the same modulation, so either every
+            // station gets a lane or none does
+            if (this->rx_processors.empty())
+                rx_processor->accept(add_lane);
+            if (add_lane.lane < 0)
+                this->rx_processors.push_back(move(rx_processor));
+        }
+    }
+
+    // Predicts the visibility windows of the next "horizon" seconds,
+    // see PassPredictor. Returns the number of windows.
+    int predict_passes(vector<Satellite> &satellites, double horizon, double grid_step, double dt) {
+        PassPredictor predictor(this->stations, satellites, dt);
+        this->windows = predictor.predict(horizon, grid_step);
+        this->next_window = 0;
+        this->active.clear();
+        return this->windows.size();
+    }
+
+    const vector<VisibilityWindow> &get_windows() { return this->windows; }
+
+    int get_num_stations() { return this->stations.size(); }
+
+    // Receives one time step at time t (s) at every station. Only
+    // satellites inside a visibility window are evaluated, stations
+    // with nothing in view only advance in time.
+    void receive(vector<Satellite> &satellites, double t) {
+        while (this->next_window < this->windows.size() && this->windows[this->next_window].rise <= t)
+            this->active.push_back(this->windows[this->next_window++]);
+        for (size_t w = 0; w < this->active.size(); )
+        {
+            if (this->active[w].set < t)
+            {
+                this->active[w] = this->active.back();
+                this->active.pop_back();
+                continue;
+            }
+            ++w;
+        }
+
+        fill(this->rf.begin(), this->rf.end(), 0);
+        fill(this->in_view.begin(), this->in_view.end(), 0);
+        for (VisibilityWindow &window : this->active)
+        {
+            double x, y, z;
+            tie(x, y, z) = this->stations[window.station].get_position(t);
+            this->rf[window.station] += satellites[window.sat].calc_field_at_point(x, y, z);
+            this->in_view[window.station] = 1;
+        }
+        if (this->rx_processors.empty())
+        {
+            this->receiver_bank.process(this->rf.data(), this->in_view.data(), this->audio.data());
+            return;
+        }
+        // stations with nothing in view only advance in time, like a
+        // bank lane
+        for (size_t g = 0; g < this->rx_processors.size(); ++g)
+            if (this->in_view[g])
+                this->audio[g] = this->rx_processors[g]->process_rx_signal(this->rf[g]);
+            else
+                this->rx_processors[g]->advance_time(1);
+    }
+
+    // 1 if station g had a satellite in view in the last time step
+    int is_in_view(int g) { return this->in_view[g]; }
+
+    double get_received_rf(int g) { return this->rf[g]; }
+    double get_received_audio(int g) { return this->audio[g]; }
+};
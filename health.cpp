@@ -0,0 +1,158 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+#include <tuple>
+
+using namespace std;
+
+//
+// Constellation health checks
+//
+// Instead of every satellite returning an Expected from every
+// move_one_frame, the whole constellation is checked every few time
+// steps. States of all satellites are gathered into flat arrays and
+// every check runs as one loop over them:
+//     - position and velocity are finite
+//     - radius stays within bounds
+//     - specific orbital energy drifts no more than a fraction of its
+//       value when the monitor was created (skipped for satellites on
+//       an ephemeris)
+// The result is one Expected<void>. On failure it holds an
+// OrbitDivergenceError listing every failing satellite, with the first
+// check it failed.
+//
+// Requires Satellite (satellite.cpp) and Expected (expected.cpp).
+//
+
+enum class HealthCheck { non_finite, radius_low, radius_high, energy_drift };
+
+struct HealthFailure {
+    int sat_id;
+    long step;
+    HealthCheck check;
+    double value;       // radius (m) or relative energy drift
+};
+
+class OrbitDivergenceError : public runtime_error {
+
+    vector<HealthFailure> failures;
+
+    static string describe(const vector<HealthFailure> &failures) {
+        ostringstream message;
+        message << "Orbit Divergence Error";
+        for (const HealthFailure &failure : failures)
+        {
+            message << "\nSatellite ID: " << failure.sat_id << " Time Step: " << failure.step << ": ";
+            switch (failure.check)
+            {
+            case HealthCheck::non_finite: message << "position or velocity is not finite"; break;
+            case HealthCheck::radius_low: message << "radius " << failure.value << " m below bound"; break;
+            case HealthCheck::radius_high: message << "radius " << failure.value << " m above bound"; break;
+            case HealthCheck::energy_drift: message << "orbital energy drifted by " << failure.value; break;
+            }
+        }
+        return message.str();
+    }
+
+public:
+    OrbitDivergenceError(const vector<HealthFailure> &failures_in)
+        : runtime_error(describe(failures_in)), failures(failures_in) {}
+
+    const vector<HealthFailure> &get_failures() const { return this->failures; }
+};
+
+class HealthMonitor {
+
+    vector<Satellite> &satellites;
+    int num_sats;
+    double min_radius;          // m
+    double max_radius;          // m
+    double max_energy_drift;    // relative
+
+    // state of every satellite at the last check
+    vector<double> x, y, z, vx, vy, vz;
+    vector<double> radius;
+    vector<double> energy;
+    vector<double> initial_energy;  // NaN when not checked
+    vector<unsigned char> failed;   // one bit per HealthCheck
+
+    void gather() {
+        for (int s = 0; s < this->num_sats; ++s)
+        {
+            tie(this->x[s], this->y[s], this->z[s]) = this->satellites[s].get_cartesian_position();
+            tie(this->vx[s], this->vy[s], this->vz[s]) = this->satellites[s].get_velocity();
+        }
+    }
+
+    // radius and specific orbital energy of every satellite
+    void compute_radius_and_energy() {
+        for (int s = 0; s < this->num_sats; ++s)
+        {
+            double r = sqrt(this->x[s] * this->x[s] + this->y[s] * this->y[s] + this->z[s] * this->z[s]);
+            double v_sq = this->vx[s] * this->vx[s] + this->vy[s] * this->vy[s] + this->vz[s] * this->vz[s];
+            this->radius[s] = r;
+            this->energy[s] = v_sq / 2 - G_M_Earth / r;
+        }
+    }
+
+public:
+    HealthMonitor(vector<Satellite> &satellites_in, double min_radius_in, double max_radius_in, double max_energy_drift_in)
+        : satellites(satellites_in)
+    {
+        this->num_sats = satellites_in.size();
+        this->min_radius = min_radius_in;
+        this->max_radius = max_radius_in;
+        this->max_energy_drift = max_energy_drift_in;
+        for (vector<double> *v : {&this->x, &this->y, &this->z, &this->vx, &this->vy, &this->vz, &this->radius, &this->energy})
+            v->resize(this->num_sats);
+        this->failed.resize(this->num_sats);
+
+        gather();
+        compute_radius_and_energy();
+        this->initial_energy = this->energy;
+        for (int s = 0; s < this->num_sats; ++s)
+            if (this->satellites[s].has_ephemeris())
+                this->initial_energy[s] = NAN;
+    }
+
+    // Checks every satellite at time step "step". Returns an
+    // OrbitDivergenceError listing all failures, if any.
+    Expected<void> check(long step) {
+        gather();
+        compute_radius_and_energy();
+
+        int any_failed = 0;
+        for (int s = 0; s < this->num_sats; ++s)
+        {
+            // x - x is NaN for NaN and Inf
+            double sum = this->x[s] + this->y[s] + this->z[s] + this->vx[s] + this->vy[s] + this->vz[s];
+            int non_finite = !(sum - sum == 0);
+            int low = this->radius[s] < this->min_radius;
+            int high = this->radius[s] > this->max_radius;
+            double drift = fabs(this->energy[s] - this->initial_energy[s]) / fabs(this->initial_energy[s]);
+            int drifted = drift > this->max_energy_drift;
+            this->failed[s] = non_finite | low << 1 | high << 2 | drifted << 3;
+            any_failed |= this->failed[s];
+        }
+        if (!any_failed)
+            return Expected<void>();
+
+        vector<HealthFailure> failures;
+        for (int s = 0; s < this->num_sats; ++s)
+        {
+            if (this->failed[s] & 1)
+                // other checks are meaningless without a finite state
+                failures.push_back({s, step, HealthCheck::non_finite, 0});
+            else if (this->failed[s] & 2)
+                failures.push_back({s, step, HealthCheck::radius_low, this->radius[s]});
+            else if (this->failed[s] & 4)
+                failures.push_back({s, step, HealthCheck::radius_high, this->radius[s]});
+            else if (this->failed[s] & 8)
+                failures.push_back({s, step, HealthCheck::energy_drift, fabs(this->energy[s] - this->initial_energy[s]) / fabs(this->initial_energy[s])});
+        }
+        return Expected<void>(OrbitDivergenceError(failures));
+    }
+};
@@ -0,0 +1,244 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <deque>
+
+using namespace std;
+
+//
+// Incremental what-if re-simulation
+//
+// A baseline run of a scenario records the RF every satellite sent in
+// every time step, and the link graph: tx -> rx is a link if rx summed
+// the field of tx (it was in contact, see ContactIndex) at a time the
+// first sample of tx could have reached it. The graph only depends on
+// geometry, not on what was sent, so it holds for any run of the same
+// scenario.
+//
+// When one satellite is changed (its transmit gain or its modulation),
+// only that satellite and everything downstream of it in the graph can
+// send or receive anything different. A what-if run therefore only
+// simulates those satellites. Every other satellite skips its DSP and
+// pushes its recorded stream into its delay line, which is all the
+// downstream satellites see of it. If the rx satellite isn't
+// downstream, the baseline output is returned without running
+// anything.
+//
+// A link's signal is the transmitter's stream delayed and scaled, so one
+// stream per transmitter serves all of its links. That costs 8 bytes
+// per time step per transmitting satellite.
+//
+// Runs advance in blocks of conservative_lookahead time steps, with
+// satellites in the order of main (0 transmits, the last one receives,
+// the rest relay). Blocks only depend on geometry, so a what-if run
+// gives exactly the rx audio of a full run with the same change.
+//
+// Requires ScenarioInstance (equivalence.cpp), conservative_lookahead
+// (tiled.cpp) and ContactIndex (contact_windows.cpp).
+//
+
+// parameters of one satellite
+struct NodeParameters {
+    string modulation;      // empty uses the scenario's
+    double tx_gain = 1;     // scales the transmitted RF
+};
+
+class LinkDependencyGraph {
+
+    int num_sats;
+    vector<unsigned char> links;    // [tx * num_sats + rx]
+
+public:
+    LinkDependencyGraph(int num_sats_in = 0) : num_sats(num_sats_in), links(num_sats_in * num_sats_in) {}
+
+    void add_link(int tx, int rx) { this->links[tx * this->num_sats + rx] = 1; }
+    int has_link(int tx, int rx) const { return this->links[tx * this->num_sats + rx]; }
+
+    // [s] is 1 for "sat" and every satellite downstream of it
+    vector<unsigned char> downstream(int sat) const {
+        vector<unsigned char> reached(this->num_sats, 0);
+        deque<int> queue = {sat};
+        reached[sat] = 1;
+        while (!queue.empty())
+        {
+            int u = queue.front();
+            queue.pop_front();
+            for (int v = 0; v < this->num_sats; ++v)
+                if (!reached[v] && has_link(u, v))
+                {
+                    reached[v] = 1;
+                    queue.push_back(v);
+                }
+        }
+        return reached;
+    }
+};
+
+struct WhatIfResult {
+    vector<int> recomputed;     // satellites that were simulated
+    vector<double> rx_audio;
+    double seconds = 0;         // wall time of the run
+};
+
+class WhatIfSimulator {
+
+    Scenario scenario;
+    int num_sats;
+    int max_block_size;
+    unique_ptr<ContactIndex> contacts;  // optional, links that are up
+    vector<unsigned char> linked;
+
+    vector<NodeParameters> baseline_params;
+    LinkDependencyGraph graph;
+    vector<vector<double>> tx_streams;  // baseline RF sent by each satellite
+    vector<double> baseline_rx_audio;
+    double baseline_seconds = 0;
+
+    vector<vector<double>> rx_blocks;
+    vector<vector<double>> tx_blocks;
+
+    int is_linked(int tx_sat_id, int rx_sat_id) {
+        return this->contacts == NULL || this->linked[tx_sat_id * this->num_sats + rx_sat_id];
+    }
+
+    // Runs the scenario with "params". Satellites with replay[s] are
+    // not simulated, they send their baseline stream. With "record" the
+    // streams and the link graph are recorded.
+    void run(const vector<NodeParameters> &params, const vector<unsigned char> &replay, int record, vector<double> &rx_audio) {
+        vector<string> modulations;
+        for (const NodeParameters &node : params)
+            modulations.push_back(node.modulation);
+        ScenarioInstance sim(this->scenario, modulations);
+
+        int rx_sat = this->num_sats - 1;
+        double dt = this->scenario.time_step;
+        long num_time_steps = this->scenario.num_time_steps;
+        rx_audio.clear();
+
+        for (long step = 0; step < num_time_steps; )
+        {
+            long remaining = num_time_steps - step;
+            int n = conservative_lookahead(sim.satellites, dt, this->max_block_size);
+            if (n > remaining)
+                n = remaining;
+            if (this->contacts != NULL)
+                this->contacts->find_links(step * dt, (step + n) * dt, this->linked);
+
+            for (int s = 0; s < this->num_sats; ++s)
+            {
+                if (replay[s])
+                {
+                    if (s < rx_sat)
+                        copy(&this->tx_streams[s][step], &this->tx_streams[s][step] + n, this->tx_blocks[s].begin());
+                    continue;
+                }
+
+                if (s == 0)
+                {
+                    for (int k = 0; k < n; ++k)
+                        this->tx_blocks[0][k] = params[0].tx_gain * sim.satellites[0].modulate(sim.wave_gen.get_next());
+                    continue;
+                }
+
+                // block is no longer than any link, so nothing of it
+                // is in a delay line yet
+                vector<double> &rf = this->rx_blocks[s];
+                fill(rf.begin(), rf.begin() + n, 0);
+                for (int u = 0; u < rx_sat; ++u)
+                {
+                    if (u == s || !is_linked(u, s))
+                        continue;
+                    if (record && step + n > sim.satellites[u].link_latency(s))
+                        this->graph.add_link(u, s);
+                    sim.satellites[u].add_field_block_at_satellite(s, rf.data(), n, 0);
+                }
+
+                if (s < rx_sat)
+                {
+                    sim.satellites[s].retransmit_block(rf.data(), this->tx_blocks[s].data(), n, 0, 1);
+                    for (int k = 0; k < n; ++k)
+                        this->tx_blocks[s][k] *= params[s].tx_gain;
+                }
+                else
+                    for (int k = 0; k < n; ++k)
+                        rx_audio.push_back(sim.satellites[s].demodulate(rf[k]));
+            }
+
+            for (int s = 0; s < rx_sat; ++s)
+            {
+                sim.satellites[s].propagate_block(this->tx_blocks[s].data(), n);
+                if (record)
+                    this->tx_streams[s].insert(this->tx_streams[s].end(), this->tx_blocks[s].begin(), this->tx_blocks[s].begin() + n);
+            }
+            for (int k = 0; k < n; ++k)
+                for (Satellite &satellite : sim.satellites)
+                    satellite.move_one_frame();
+            step += n;
+        }
+    }
+
+public:
+    WhatIfSimulator(const Scenario &scenario_in, int max_block_size_in)
+        : scenario(scenario_in), num_sats(scenario_in.num_satellites), max_block_size(max_block_size_in),
+          baseline_params(scenario_in.num_satellites), graph(scenario_in.num_satellites),
+          rx_blocks(scenario_in.num_satellites, vector<double>(max_block_size_in)),
+          tx_blocks(scenario_in.num_satellites, vector<double>(max_block_size_in)) {}
+
+    // Only links between satellites in contact are evaluated, see
+    // ContactPredictor. Call before run_baseline.
+    void use_contact_windows(double grazing_altitude, double max_range, double grid_step) {
+        ScenarioInstance sim(this->scenario);
+        ContactPredictor predictor(sim.satellites, grazing_altitude, max_range, this->scenario.time_step);
+        this->contacts = make_unique<ContactIndex>(predictor.predict((this->scenario.num_time_steps + 1) * this->scenario.time_step, grid_step), this->num_sats);
+    }
+
+    // Runs and records the baseline, every satellite with "params"
+    const vector<double> &run_baseline(const vector<NodeParameters> &params) {
+        auto start = chrono::steady_clock::now();
+        this->baseline_params = params;
+        this->graph = LinkDependencyGraph(this->num_sats);
+        this->tx_streams.assign(this->num_sats, vector<double>());
+        for (int s = 0; s < this->num_sats - 1; ++s)
+            this->tx_streams[s].reserve(this->scenario.num_time_steps);
+        run(params, vector<unsigned char>(this->num_sats, 0), 1, this->baseline_rx_audio);
+        this->baseline_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return this->baseline_rx_audio;
+    }
+
+    // The baseline with satellite "sat" changed to "changed". Only "sat"
+    // and the satellites downstream of it are simulated.
+    WhatIfResult run_what_if(int sat, const NodeParameters &changed) {
+        auto start = chrono::steady_clock::now();
+        vector<NodeParameters> params = this->baseline_params;
+        params[sat] = changed;
+        vector<unsigned char> affected = this->graph.downstream(sat);
+
+        WhatIfResult result;
+        if (!affected[this->num_sats - 1])
+            result.rx_audio = this->baseline_rx_audio;
+        else
+        {
+            vector<unsigned char> replay(this->num_sats);
+            for (int s = 0; s < this->num_sats; ++s)
+            {
+                replay[s] = !affected[s];
+                if (affected[s])
+                    result.recomputed.push_back(s);
+            }
+            run(params, replay, 0, result.rx_audio);
+        }
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    // every satellite simulated with "params", for comparison
+    vector<double> run_full(const vector<NodeParameters> &params) {
+        vector<double> rx_audio;
+        run(params, vector<unsigned char>(this->num_sats, 0), 0, rx_audio);
+        return rx_audio;
+    }
+
+    const LinkDependencyGraph &get_graph() { return this->graph; }
+    double get_baseline_seconds() { return this->baseline_seconds; }
+};
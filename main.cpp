@@ -1,9 +1,28 @@
 #include <iostream>
-// #include <expected/expected.h>
+#include "expected.cpp"
 #include "satellite.cpp"
 #include "data_source.cpp"
 #include "versioning.cpp"
 #include "IndentStream.cpp"
+#include "async_output.cpp"
+#include "audio_file.cpp"
+#include "trace.cpp"
+#include "pipeline.cpp"
+#include "window_search.cpp"
+#include "contact_windows.cpp"
+#include "block_relay.cpp"
+#include "tiled.cpp"
+#include "fast_forward.cpp"
+#include "behaviour.cpp"
+#include "stats.cpp"
+#include "memory_report.cpp"
+#include "sharded.cpp"
+#include "ground_station.cpp"
+#include "health.cpp"
+#include "forces.cpp"
+#include "symbol_level.cpp"
+#include "equivalence.cpp"
+#include "incremental.cpp"
 
 //
 // External repos used:
@@ -11,8 +30,8 @@
 // For signal processing:
 // https://github.com/overlord1123/LowPassFilter
 //
-// For exceptions (implementation not complete):
-// expected.h, written by Gilles Bellot, based on talk:
+// For exceptions:
+// expected.cpp, written by Gilles Bellot, based on talk:
 // "C++ and Beyond 2012: Andrei Alexandrescu - Systematic Error Handling in C++""
 //
 // IndendStream.hpp from Uchicago MPCS51045 Advanced C++
@@ -27,7 +46,6 @@ int main(int argc, char * argv[])
     unique_ptr<AbstractSigProcFactory> sig_proc_factory;
     vector<Satellite> satellites;
     tuple<double, double, double> position_holder;
-    // vector<util::Expected<void>> exceptions(num_satellites);
     SatellitePositions sat_pos(num_satellites);
     EMField em_field(num_satellites);
     double frequency = 25000;
@@ -40,15 +58,187 @@ int main(int argc, char * argv[])
     double gain = 10000;
     int print_signal = 1;
     int debug = 0;
+    // number of carriers per satellite. With more than one channel,
+    // channel i uses carrier frequency + i * channel_spacing and the
+    // receiver splits channels with a polyphase FFT channelizer.
+    // (1 / (time_step * channel_spacing) must be a power of two)
+    int num_channels = 1;
+    double channel_spacing = frequency;
+    vector<double> channel_audio(num_channels);
+    // output is written to cout by a separate thread. Policy
+    // decides what happens when output can't keep up.
+    size_t output_buffer_bytes = 1 << 20;
+    OverflowPolicy output_policy = OverflowPolicy::block;
+    // run orbit, tx, propagation and rx as pipelined stages on
+    // separate threads (single channel only)
+    int use_pipeline = 0;
+    int pipeline_block_size = 256;
+    // process relays a block at a time, concurrently where link
+    // latencies allow. Transparent relays forward RF without
+    // demodulating. (single channel only)
+    int use_block_relay = 0;
+    int relay_block_size = 1024;
+    int transparent_relays = 0;
+    // the block relay engine only evaluates links between satellites
+    // in contact: line of sight at least link_grazing_altitude above
+    // the earth and, unless 0, within max_link_range (m). Contacts are
+    // predicted on a contact_prediction_step (s) grid before the
+    // simulation starts.
+    int use_contact_windows = 0;
+    double link_grazing_altitude = 100000;
+    double max_link_range = 0;
+    double contact_prediction_step = 10;
+    // split satellites across num_shards processes, which exchange
+    // the field crossing shard boundaries once per relay_block_size
+    // block through shared memory (single channel only)
+    int use_shards = 0;
+    int num_shards = 2;
+    // each satellite runs through tiles of time steps on its own, as
+    // long as the shortest link's propagation delay allows (at most
+    // max_tile_size), with satellites spread over num_tile_threads
+    // threads (single channel only)
+    int use_tiles = 0;
+    int max_tile_size = 16384;
+    int num_tile_threads = 4;
+    // received audio written to a WAV file (optional third argument)
+    // at this rate. wav_output_scale maps to full scale.
+    double wav_output_rate = 44100;
+    double wav_output_scale = 1;
+    unique_ptr<WavFileSource> wav_source;
+    unique_ptr<WavFileSink> wav_sink;
+    // compare a fast engine against the per sample path and
+    // print a report instead of running the simulation
+    int run_equivalence_check = 0;
+    FastPath equivalence_fast_path = FastPath::block_relay;
+    // run the scenario, then again with what_if_satellite's transmit
+    // gain set to what_if_tx_gain and, unless empty, its modulation to
+    // what_if_modulation. The second run only simulates the satellites
+    // downstream of the change in the link graph of the first run
+    // (links of use_contact_windows only), and prints a report instead
+    // of running the simulation.
+    int run_what_if = 0;
+    int what_if_satellite = 1;
+    double what_if_tx_gain = 2;
+    string what_if_modulation = "";
+    // transmit in bursts of burst_length seconds every burst_period
+    // seconds, and fast forward over silence between bursts
+    // (single channel only)
+    int use_fast_forward = 0;
+    double burst_period = 0.5;
+    double burst_length = 0.05;
+    // each satellite follows a behaviour script run by an event
+    // scheduler, idle satellites are not simulated. Default scripts
+    // match the loop below, with the tx satellite transmitting in
+    // bursts as above. (single channel only)
+    int use_behaviours = 0;
+    // demodulate all receivers of the scheduler at once, in a
+    // vectorized receiver bank
+    int use_receiver_bank = 0;
+    // live stats published to this POSIX shared memory segment every
+    // stats_publish_interval time steps, read by stats_monitor.
+    // Empty disables.
+    string stats_segment = "";
+    long stats_publish_interval = 4096;
+    // orbits are evaluated from a Chebyshev ephemeris file instead of
+    // being integrated. The file is generated if it is missing or was
+    // made for another constellation, and memory mapped otherwise.
+    // Empty path disables.
+    string ephemeris_path = "";
+    int ephemeris_segment_steps = 4096;
+    int ephemeris_num_coeffs = 8;
+    unique_ptr<Ephemeris> ephemeris;
+    unsigned orbit_seed = 7;
+    double orbit_radius = 8357000;
+    // ground stations at random places on the earth, which hear a
+    // satellite while it is above ground_min_elevation (degrees).
+    // Passes are predicted on a pass_prediction_step (s) grid before
+    // the simulation starts. (single channel only)
+    int num_ground_stations = 0;
+    double ground_min_elevation = 10;
+    double pass_prediction_step = 10;
+    unique_ptr<GroundSegment> ground_segment;
+    // white Gaussian noise on every link, with the SNR of link_budget
+    // at the link's distance, and phase noise of an oscillator with
+    // phase_noise_linewidth (Hz, 0 disables). The modulators' carrier
+    // amplitude is 1, so budget's tx_power is at an RF rms of 1 / sqrt(2).
+    int use_channel_impairments = 0;
+    LinkBudget link_budget;
+    double phase_noise_linewidth = 0;
+    unique_ptr<ChannelImpairments> channel;
+    // every health_check_interval time steps all orbits are checked for
+    // NaN / Inf, a radius outside [earth_radius, max_orbit_radius] and a
+    // relative drift of orbital energy above max_energy_drift. 0 disables.
+    long health_check_interval = 64;
+    double max_orbit_radius = 4 * orbit_radius;
+    double max_energy_drift = 0.01;
+    // orbits of all satellites are advanced together with a force
+    // model (point mass gravity, J2, drag, moon and sun) instead of
+    // by each satellite (main loop only)
+    int use_force_model = 0;
+    unique_ptr<ConstellationPropagator<LeoForceModel>> propagator;
+    // digital modes (BPSK, QPSK) send a PRBS test pattern at frequency
+    // / 10 symbols per second and the rx satellite counts bit errors.
+    // With use_symbol_level the tx -> rx link is simulated for
+    // num_symbols symbols at one sample per symbol instead, with ideal
+    // synchronization and the link's gain, delay and noise updated
+    // every symbol_block_size symbols.
+    int bits_per_symbol = 0;
+    int use_symbol_level = 0;
+    long num_symbols = 100000000;
+    int symbol_block_size = 4096;
+    // the signals of the tx and rx satellites are kept for
+    // capture_pre_trigger seconds, and written to capture_path from
+    // capture_pre_trigger before to capture_post_trigger after the
+    // received RF level (mean |sample| over capture_envelope_time)
+    // stays below capture_threshold for capture_hold_time, i.e. a fade
+    // or dropout. Print with capture_dump. Empty path disables.
+    // (main loop, single channel only)
+    string capture_path = "";
+    double capture_pre_trigger = 0.005;
+    double capture_post_trigger = 0.005;
+    CaptureTrigger capture_trigger;
+    capture_trigger.condition = TriggerCondition::below;
+    capture_trigger.threshold = 1e-8;
+    capture_trigger.envelope_time = 0.0005;
+    double capture_hold_time = 0.0002;
+    unique_ptr<CaptureSet> capture;
+    // directional antennas on every satellite: the pattern table of
+    // antenna_pattern_path (see antenna.cpp), or a Gaussian beam of
+    // antenna_beamwidth (degrees) with antenna_peak_gain and
+    // antenna_sidelobe_gain (dBi) if the path is empty. Every satellite
+    // points at the next one of the relay chain, the rx satellite at
+    // the one before it. Beams are steered and link gains updated
+    // every antenna_update_interval time steps. (main loop only)
+    int use_antennas = 0;
+    string antenna_pattern_path = "";
+    double antenna_beamwidth = 30;
+    double antenna_peak_gain = 15;
+    double antenna_sidelobe_gain = -10;
+    long antenna_update_interval = 4096;
+    unique_ptr<AntennaPattern> antenna_pattern;
+    unique_ptr<LinkGains> link_gains;
+    // memory is tracked by subsystem (delay lines, recycling bin, EM
+    // field, satellites, other) in builds with -DMEMORY_ACCOUNTING.
+    // With print_memory_report the current and peak bytes and the
+    // delay line of every transmitter are printed at exit, and by the
+    // main loop whenever the process gets SIGUSR1.
+    int print_memory_report = 0;
 
-    IndentStream ins(cout);
+    AsyncOutputWriter output_writer(cout, output_buffer_bytes, output_policy);
+    AsyncOutputStream async_out(output_writer);
+    IndentStream ins(async_out);
+    MemoryReportAtExit memory_report(ins, satellites, print_memory_report);
+    if (print_memory_report)
+        MemoryAccounting::enable_report_signal();
     ins << "Running Version #: " << version << endl;
     ins << "Version Name: " << version_msg << endl;
 
     // Parse Arguments and create correct factory for
     // singal processing type.
+    // Optional second and third arguments are a WAV file to transmit
+    // instead of the tone and a WAV file for the received audio.
     if (argc == 1) {
-        ins << "Please provide modulation method (AM or FM)" << endl;
+        ins << "Please provide modulation method (AM, FM, BPSK or QPSK)" << endl;
         return 0;
     }
     else if (strcmp(argv[1], "AM") == 0) {
@@ -57,30 +247,302 @@ int main(int argc, char * argv[])
     else if (strcmp(argv[1], "FM") == 0) {
         sig_proc_factory = make_unique<FMProcessingFactory>();
     }
+    else if (strcmp(argv[1], "BPSK") == 0) {
+        sig_proc_factory = make_unique<BPSKProcessingFactory>();
+        bits_per_symbol = 1;
+    }
+    else if (strcmp(argv[1], "QPSK") == 0) {
+        sig_proc_factory = make_unique<QPSKProcessingFactory>();
+        bits_per_symbol = 2;
+    }
     else {
-        ins << "Invalid Modulation method. Specify AM or FM." << endl;
+        ins << "Invalid Modulation method. Specify AM, FM, BPSK or QPSK." << endl;
+        return 0;
+    }
+
+    if (run_equivalence_check) {
+        Scenario scenario;
+        scenario.modulation = argv[1];
+        scenario.num_satellites = num_satellites;
+        scenario.frequency = frequency;
+        scenario.time_step = time_step;
+        scenario.audio_tone_frequency = audio_tone_frequency;
+        scenario.gain = gain;
+        scenario.num_time_steps = num_time_steps;
+        scenario.block_size = equivalence_fast_path == FastPath::pipeline ? pipeline_block_size
+            : (equivalence_fast_path == FastPath::tiled ? max_tile_size : relay_block_size);
+        EquivalenceHarness harness(scenario);
+        harness.run(equivalence_fast_path, ins);
+        return 0;
+    }
+
+    if (run_what_if) {
+        Scenario scenario;
+        scenario.modulation = argv[1];
+        scenario.num_satellites = num_satellites;
+        scenario.frequency = frequency;
+        scenario.time_step = time_step;
+        scenario.audio_tone_frequency = audio_tone_frequency;
+        scenario.gain = gain;
+        scenario.seed = orbit_seed;
+        scenario.orbit_radius = orbit_radius;
+        scenario.num_time_steps = num_time_steps;
+        WhatIfSimulator what_if(scenario, max_tile_size);
+        if (use_contact_windows)
+            what_if.use_contact_windows(link_grazing_altitude, max_link_range, contact_prediction_step);
+        const vector<double> &baseline_audio = what_if.run_baseline(vector<NodeParameters>(num_satellites));
+        NodeParameters changed;
+        changed.modulation = what_if_modulation;
+        changed.tx_gain = what_if_tx_gain;
+        WhatIfResult result = what_if.run_what_if(what_if_satellite, changed);
+
+        double max_change = 0;
+        for (size_t k = 0; k < result.rx_audio.size() && k < baseline_audio.size(); ++k)
+            max_change = max(max_change, fabs(result.rx_audio[k] - baseline_audio[k]));
+        ins << "What-If Report (Satellite " << what_if_satellite << ", " << num_time_steps << " time steps):" << indent << endl;
+        ins << "Recomputed Satellites:";
+        for (int s : result.recomputed)
+            ins << " " << s;
+        ins << endl;
+        ins << "Baseline: " << what_if.get_baseline_seconds() << " s, What-If: " << result.seconds << " s" << endl;
+        ins << "Received Audio Max Change: " << max_change << unindent << endl;
+        return 0;
+    }
+
+    if (num_channels > 1 && !ChannelizedReceiver::fits_channelizer(frequency, channel_spacing, num_channels, time_step)) {
+        ins << "Channel plan doesn't fit the channelizer: 1 / (time_step * channel_spacing) must be a power of two, "
+            << "and every carrier a multiple of channel_spacing below half the sample rate" << endl;
         return 0;
     }
 
     // random values are used for satellite orbit initial conditions
-    srand(7);
+    srand(orbit_seed);
+
+    // initialize satellites, constructed in place so the satellite
+    // objects are charged to the satellites too
+    {
+        MemoryScope scope(MemorySubsystem::satellites);
+        satellites.reserve(num_satellites);
+        for (int i = 0; i < num_satellites; ++i)
+            satellites.emplace_back(i, sig_proc_factory, &sat_pos, &em_field, time_step, frequency, orbit_radius, num_channels, channel_spacing);
+    }
 
-    // initialize satellites
-    for (int i = 0; i < num_satellites; ++i)
-        satellites.emplace_back(Satellite(i, sig_proc_factory, &sat_pos, &em_field, time_step, frequency, 8357000));
+    if (!ephemeris_path.empty()) {
+        ephemeris = make_unique<Ephemeris>(ephemeris_path.c_str());
+        if (!ephemeris->matches(num_satellites, time_step, orbit_radius, orbit_seed, num_time_steps)) {
+            ins << "Generating Ephemeris: " << ephemeris_path << endl;
+            ephemeris.reset();
+            EphemerisWriter writer(num_satellites, ephemeris_segment_steps, ephemeris_num_coeffs);
+            writer.record(sat_pos);
+            while (!writer.covers(num_time_steps)) {
+                for (Satellite &satellite : satellites)
+                    satellite.move_one_frame();
+                writer.record(sat_pos);
+            }
+            if (!writer.write(ephemeris_path.c_str(), time_step, orbit_radius, orbit_seed)) {
+                ins << "Could not write ephemeris file: " << ephemeris_path << endl;
+                return 0;
+            }
+            ephemeris = make_unique<Ephemeris>(ephemeris_path.c_str());
+        }
+        if (!ephemeris->is_valid()) {
+            ins << "Could not read ephemeris file: " << ephemeris_path << endl;
+            return 0;
+        }
+        for (Satellite &satellite : satellites)
+            satellite.set_ephemeris(ephemeris.get());
+    }
+
+    if (use_channel_impairments) {
+        channel = make_unique<ChannelImpairments>(num_satellites, time_step, frequency, orbit_seed);
+        channel->set_awgn(link_budget, M_SQRT1_2);
+        channel->set_phase_noise(phase_noise_linewidth);
+        for (Satellite &satellite : satellites)
+            satellite.set_channel(channel.get());
+    }
+
+    if (use_symbol_level) {
+        if (bits_per_symbol == 0) {
+            ins << "Symbol level simulation needs BPSK or QPSK" << endl;
+            return 0;
+        }
+        SymbolLevelSimulator symbol_level(satellites, channel.get(), bits_per_symbol, psk_symbol_rate(frequency), time_step, symbol_block_size, orbit_seed);
+        SymbolLevelResult result = symbol_level.run(tx_satellite, rx_satellite, num_symbols);
+        ins << "Symbol Level Simulation: Satellite " << tx_satellite << " to Satellite " << rx_satellite << endl;
+        ins << "Symbols: " << result.symbols << " Bits: " << result.bits << " Bit Errors: " << result.bit_errors
+            << " Bit Error Rate: " << (result.bits > 0 ? (double) result.bit_errors / result.bits : 0)
+            << " Expected Bit Error Rate: " << (result.bits > 0 ? result.expected_bit_errors / result.bits : 0) << endl;
+        return 0;
+    }
 
     // initialize tone generator
     WaveGenerator wave_gen(audio_tone_frequency, time_step, gain);
+    AudioSource *audio_source = &wave_gen;
+    if (argc > 2) {
+        wav_source = make_unique<WavFileSource>(argv[2], time_step, gain);
+        if (!wav_source->is_valid()) {
+            ins << "Could not read WAV file: " << argv[2] << endl;
+            return 0;
+        }
+        audio_source = wav_source.get();
+    }
+    if (argc > 3) {
+        wav_sink = make_unique<WavFileSink>(argv[3], time_step, wav_output_rate, wav_output_scale);
+        if (!wav_sink->is_valid()) {
+            ins << "Could not write WAV file: " << argv[3] << endl;
+            return 0;
+        }
+    }
+    // each channel gets a different tone
+    vector<WaveGenerator> channel_wave_gens;
+    for (int c = 0; c < num_channels; ++c)
+        channel_wave_gens.emplace_back(audio_tone_frequency * (c + 1), time_step, gain);
+
+    if (use_pipeline && num_channels == 1) {
+        PipelinedEngine pipeline(satellites, &sat_pos, *audio_source, pipeline_block_size);
+        pipeline.set_audio_sink(wav_sink.get());
+        pipeline.run(num_time_steps, ins);
+        return 0;
+    }
+
+    if (use_block_relay && num_channels == 1) {
+        BlockRelayEngine block_relay(satellites, *audio_source, relay_block_size, transparent_relays);
+        block_relay.set_audio_sink(wav_sink.get());
+        unique_ptr<ContactIndex> contacts;
+        if (use_contact_windows) {
+            ContactPredictor predictor(satellites, link_grazing_altitude, max_link_range, time_step);
+            contacts = make_unique<ContactIndex>(predictor.predict((num_time_steps + 1) * time_step, contact_prediction_step), num_satellites);
+            ins << "Contact Windows: " << contacts->get_num_windows() << endl;
+            block_relay.set_contact_index(contacts.get(), time_step);
+        }
+        block_relay.run(num_time_steps, ins);
+        return 0;
+    }
+
+    if (use_tiles && num_channels == 1) {
+        TiledEngine tiled(satellites, *audio_source, time_step, max_tile_size, num_tile_threads, transparent_relays);
+        tiled.set_audio_sink(wav_sink.get());
+        tiled.run(num_time_steps, ins);
+        return 0;
+    }
+
+    if (use_shards && num_channels == 1) {
+        ShardedEngine sharded(satellites, *audio_source, num_shards, relay_block_size, transparent_relays);
+        if (!sharded.is_valid()) {
+            ins << "Could not set up shards: num_shards must be at least 1 and shared memory mappable" << endl;
+            return 0;
+        }
+        sharded.set_audio_sink(wav_sink.get());
+        if (!sharded.run(num_time_steps, ins))
+            ins << "A shard process failed" << endl;
+        return 0;
+    }
+
+    if (use_fast_forward && num_channels == 1) {
+        TransmitSchedule schedule(round(burst_period / time_step), round(burst_length / time_step));
+        FastForwardEngine fast_forward(satellites, *audio_source, schedule);
+        fast_forward.set_audio_sink(wav_sink.get());
+        fast_forward.run(num_time_steps, ins);
+        return 0;
+    }
+
+    if (use_behaviours && num_channels == 1) {
+        BehaviourScheduler scheduler(satellites, *audio_source);
+        long burst_steps = round(burst_length / time_step);
+        scheduler.set_script(tx_satellite, BehaviourScript().transmit(burst_steps).idle(round(burst_period / time_step) - burst_steps).repeat());
+        for (int j = 1; j < num_satellites - 1; ++j)
+            scheduler.set_script(j, BehaviourScript().relay(-1));
+        scheduler.set_script(rx_satellite, BehaviourScript().receive(-1));
+        scheduler.set_audio_sink(wav_sink.get());
+        if (use_receiver_bank)
+            scheduler.use_receiver_bank();
+        scheduler.run(num_time_steps, ins);
+        return 0;
+    }
+
+    if (num_ground_stations > 0 && num_channels == 1) {
+        // passes are predicted with the orbit the run uses, which the
+        // force model only has through an ephemeris
+        if (use_force_model && ephemeris == NULL) {
+            ins << "Ground stations need an ephemeris when the force model is used" << endl;
+            return 0;
+        }
+        vector<GroundStation> stations;
+        for (int g = 0; g < num_ground_stations; ++g) {
+            double latitude = asin(2.0 * rand() / RAND_MAX - 1);
+            double longitude = (double) rand() / RAND_MAX * 2 * M_PI;
+            stations.push_back({latitude, longitude, 0, ground_min_elevation * M_PI / 180});
+        }
+        ground_segment = make_unique<GroundSegment>(stations, sig_proc_factory, frequency, time_step);
+        ground_segment->predict_passes(satellites, (num_time_steps + 1) * time_step, pass_prediction_step, time_step);
+        for (const VisibilityWindow &window : ground_segment->get_windows())
+            ins << "Visibility Window: Ground Station " << window.station << ", Satellite " << window.sat
+                << ", Rise: " << window.rise << " s, Set: " << window.set << " s" << endl;
+    }
+
+    if (use_antennas) {
+        if (antenna_pattern_path.empty())
+            antenna_pattern = make_unique<AntennaPattern>(AntennaPattern::gaussian_beam(antenna_beamwidth * M_PI / 180, antenna_peak_gain, antenna_sidelobe_gain));
+        else
+            antenna_pattern = make_unique<AntennaPattern>(antenna_pattern_path.c_str());
+        if (!antenna_pattern->is_valid()) {
+            ins << "Could not read antenna pattern: " << antenna_pattern_path << endl;
+            return 0;
+        }
+        link_gains = make_unique<LinkGains>(&sat_pos);
+        for (int j = 0; j < num_satellites; ++j) {
+            link_gains->set_pattern(j, antenna_pattern.get());
+            link_gains->track(j, j < rx_satellite ? j + 1 : j - 1);
+            satellites[j].set_link_gains(link_gains.get());
+        }
+    }
+
+    if (use_force_model && ephemeris == NULL)
+        propagator = make_unique<ConstellationPropagator<LeoForceModel>>(satellites, &sat_pos, time_step);
+
+    if (!capture_path.empty() && num_channels == 1) {
+        capture = make_unique<CaptureSet>(capture_path.c_str(), time_step, capture_pre_trigger, capture_post_trigger);
+        if (!capture->is_valid()) {
+            ins << "Could not write capture file: " << capture_path << endl;
+            return 0;
+        }
+        capture_trigger.hold_steps = max(1L, lround(capture_hold_time / time_step));
+        CaptureTap *tx_audio_tap = capture->add_tap("tx audio");
+        CaptureTap *tx_rf_tap = capture->add_tap("tx rf");
+        CaptureTap *rx_rf_tap = capture->add_tap("rx rf", capture_trigger);
+        CaptureTap *rx_audio_tap = capture->add_tap("rx audio");
+        satellites[tx_satellite].set_capture_taps(tx_audio_tap, tx_rf_tap, NULL, NULL);
+        satellites[rx_satellite].set_capture_taps(NULL, NULL, rx_rf_tap, rx_audio_tap);
+    }
+
+    StatsPublisher stats(stats_segment, {"tx", "relay", "rx"});
+    HealthMonitor health_monitor(satellites, earth_radius, max_orbit_radius, max_energy_drift);
 
     // start simulation
     // loop once for each time step
     for (int i = 0; i < num_time_steps; ++i)
     {
+        stats.start_step(i);
         ins << "Time Step: " << i << indent << endl;
 
+        // with a propagator, move_one_frame below does nothing
+        if (propagator != NULL)
+            propagator->step();
+
+        if (link_gains != NULL && i % antenna_update_interval == 0)
+            link_gains->update();
+
         // generates sample of sin wave
-        audio_signal = wave_gen.get_next();
-        ins << "Transmitted Audio Sample: " << audio_signal << endl;
+        if (num_channels > 1) {
+            for (int c = 0; c < num_channels; ++c) {
+                channel_audio[c] = channel_wave_gens[c].get_next();
+                ins << "Transmitted Audio Sample (Channel " << c << "): " << channel_audio[c] << endl;
+            }
+        }
+        else {
+            audio_signal = audio_source->get_next();
+            ins << "Transmitted Audio Sample: " << audio_signal << endl;
+        }
 
         // move satellite one time step (Note that a bug occurs where satellite
         // positions rapidly diverge. Need to keep number of timesteps below 30.)
@@ -91,18 +553,20 @@ int main(int argc, char * argv[])
             << " meters , rho: " << (180 / M_PI) * get<1>(position_holder)
             << " degrees, theta: " << (180 / M_PI) * get<2>(position_holder) 
             << " degrees " << unindent << endl;
-        // exceptions[tx_satellite] = satellites[tx_satellite].move_one_frame();
         // transmit sin wave sample using transmission satellite
-        satellites[tx_satellite].transmit_signal(audio_signal, debug);
+        if (num_channels > 1)
+            satellites[tx_satellite].transmit_signals(channel_audio, debug);
+        else
+            satellites[tx_satellite].transmit_signal(audio_signal, debug);
         ins << "Transmitted RF Sample: " <<
                  satellites[tx_satellite].get_last_processed_tx_sample() << endl;
+        stats.end_stage(0);
 
         // retransmit signal using non Tx/Rx satellites
         for (int j = 1; j < num_satellites-1; ++j)
         {
             // move satellite one time step
             satellites[j].move_one_frame();
-            // exceptions[j] = satellites[j].move_one_frame();
             ins << "Satellite ID: "<< j <<  " Position: " << indent << endl;
             ins << "r: " << get<0>(position_holder)
                 << " meters , rho: " << (180 / M_PI) * get<1>(position_holder)
@@ -110,6 +574,16 @@ int main(int argc, char * argv[])
                 << " degrees " << unindent << endl;
             satellites[j].retransmit();
         }
+        stats.end_stage(1);
+
+        // ground stations hear the transmitters and relays of this
+        // time step, only while a satellite is in view
+        if (ground_segment != NULL) {
+            ground_segment->receive(satellites, (i + 1) * time_step);
+            for (int g = 0; g < ground_segment->get_num_stations(); ++g)
+                if (ground_segment->is_in_view(g))
+                    ins << "Received Audio Sample (Ground Station " << g << "): " << ground_segment->get_received_audio(g) << endl;
+        }
         
         // move satellite one time step
         satellites[rx_satellite].move_one_frame();
@@ -119,25 +593,68 @@ int main(int argc, char * argv[])
             << " meters , rho: " << (180 / M_PI) * get<1>(position_holder)
             << " degrees, theta: " << (180 / M_PI) * get<2>(position_holder) 
             << " degrees " << unindent << endl;
-        // exceptions[rx_satellite] = satellites[rx_satellite].move_one_frame();
         // receive signal 
-        audio_signal = satellites[rx_satellite].receive_signal(debug);
-        ins << "Received RF Sample: " <<
-                 satellites[rx_satellite].get_last_received_rf_sample() << endl;
-
-        // print signal
-        ins << "Received Audio Sample: " << audio_signal << unindent << endl;
-
-        // TODO: exception generation incomplete
-        // for (int j = 0; j < num_satellites; ++j) {
-        //     if (~exceptions[i].isValid()) {
-        //         cout << "Exception Found! Satellited ID: " << i
-        //              << "Time Step: " << j << endl;
-        //         cout << "Exitting" << endl;
-        //         return 0;
-        //     }
-        // }
+        if (num_channels > 1) {
+            // channel samples are only ready once per channelizer block
+            int ready = satellites[rx_satellite].receive_signals(channel_audio);
+            ins << "Received RF Sample: " <<
+                     satellites[rx_satellite].get_last_received_rf_sample() << endl;
+            for (int c = 0; ready && c < num_channels; ++c)
+                ins << "Received Audio Sample (Channel " << c << "): " << channel_audio[c] << endl;
+            ins << unindent;
+        }
+        else {
+            audio_signal = satellites[rx_satellite].receive_signal(debug);
+            ins << "Received RF Sample: " <<
+                     satellites[rx_satellite].get_last_received_rf_sample() << endl;
+
+            // print signal
+            ins << "Received Audio Sample: " << audio_signal << unindent << endl;
+            if (wav_sink != NULL)
+                wav_sink->write(audio_signal);
+        }
+        stats.end_stage(2);
+        if (capture != NULL)
+            capture->end_step();
+
+        if (stats.is_enabled() && (i + 1) % stats_publish_interval == 0) {
+            int active_links = 0;
+            long buffer_bytes = 0;
+            for (Satellite &satellite : satellites) {
+                active_links += satellite.count_active_links();
+                buffer_bytes += satellite.get_buffer_bytes();
+            }
+            stats.publish(i + 1, (i + 1) * time_step, active_links, buffer_bytes);
+        }
+
+        if (print_memory_report && MemoryAccounting::take_report_request())
+            print_memory_footprint(ins, satellites);
+
+        if (health_check_interval > 0 && (i + 1) % health_check_interval == 0) {
+            Expected<void> health = health_monitor.check(i);
+            if (!health.isValid()) {
+                try {
+                    health.get();
+                }
+                catch (const OrbitDivergenceError &error) {
+                    ins << error.what() << endl;
+                }
+                if (capture != NULL)
+                    capture->finish();
+                ins << "Exiting" << endl;
+                return 0;
+            }
+        }
+    }
+
+    if (capture != NULL) {
+        capture->finish();
+        ins << "Captured Windows: " << capture->get_num_captures() << endl;
     }
 
+    // bit errors of digital modes
+    if (num_channels == 1)
+        satellites[rx_satellite].accept_rx_visitor(PrintBitErrorRate(ins));
+
     return 0;
 }
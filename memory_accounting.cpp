@@ -0,0 +1,173 @@
+#include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <csignal>
+#include <new>
+
+using namespace std;
+
+//
+// Memory accounting by subsystem
+//
+// Built with -DMEMORY_ACCOUNTING, global operator new / delete are
+// replaced, and every block carries a small header with its size and
+// the subsystem it was allocated for. Without it the allocator is left
+// alone, scopes cost a thread local store and report() says accounting
+// is off.
+// The subsystem is whatever MemoryScope is innermost on the allocating
+// thread (MemorySubsystem::other outside of any scope). Current bytes,
+// peak bytes and allocation counts are kept per subsystem in atomic
+// counters, so any thread can allocate. Each subsystem's counters sit
+// on their own cache line, so threads allocating for different
+// subsystems don't contend.
+//
+// Delay line vectors are handed to the recycling bin when a
+// transmitter frees its buffer and taken back by the next buffer, so
+// their bytes are moved between the two subsystems with transfer().
+//
+// report() prints the counters. Raising SIGUSR1 sets a flag that the
+// main loop polls with take_report_request() to print a report on
+// demand.
+//
+
+enum class MemorySubsystem { other, delay_lines, recycling_bin, em_field, satellites, count };
+
+const char *const memory_subsystem_names[] = {"Other", "Delay Lines", "Recycling Bin", "EM Field", "Satellites"};
+
+struct alignas(64) MemoryCounters {
+    atomic<long> current_bytes{0};
+    atomic<long> peak_bytes{0};
+    atomic<long> allocations{0};
+    atomic<long> frees{0};
+};
+
+class MemoryAccounting {
+
+    static MemoryCounters counters[(int) MemorySubsystem::count];
+    static MemoryCounters total;
+    static thread_local MemorySubsystem current_subsystem;
+    static atomic<int> report_requested;
+
+    static void add(MemoryCounters &c, long bytes) {
+        long current = c.current_bytes.fetch_add(bytes, memory_order_relaxed) + bytes;
+        long peak = c.peak_bytes.load(memory_order_relaxed);
+        while (current > peak && !c.peak_bytes.compare_exchange_weak(peak, current, memory_order_relaxed))
+            ;
+    }
+
+    static void on_report_signal(int) { report_requested.store(1, memory_order_relaxed); }
+
+    friend class MemoryScope;
+
+public:
+    static MemorySubsystem get_current_subsystem() { return current_subsystem; }
+
+    static void record_allocation(MemorySubsystem subsystem, long bytes) {
+        add(counters[(int) subsystem], bytes);
+        add(total, bytes);
+        counters[(int) subsystem].allocations.fetch_add(1, memory_order_relaxed);
+        total.allocations.fetch_add(1, memory_order_relaxed);
+    }
+
+    static void record_free(MemorySubsystem subsystem, long bytes) {
+        counters[(int) subsystem].current_bytes.fetch_sub(bytes, memory_order_relaxed);
+        total.current_bytes.fetch_sub(bytes, memory_order_relaxed);
+        counters[(int) subsystem].frees.fetch_add(1, memory_order_relaxed);
+        total.frees.fetch_add(1, memory_order_relaxed);
+    }
+
+    // moves "bytes" of live blocks from one subsystem to another
+    static void transfer(MemorySubsystem from, MemorySubsystem to, long bytes) {
+        counters[(int) from].current_bytes.fetch_sub(bytes, memory_order_relaxed);
+        add(counters[(int) to], bytes);
+    }
+
+    static long get_current_bytes(MemorySubsystem subsystem) { return counters[(int) subsystem].current_bytes.load(memory_order_relaxed); }
+    static long get_peak_bytes(MemorySubsystem subsystem) { return counters[(int) subsystem].peak_bytes.load(memory_order_relaxed); }
+    static long get_allocations(MemorySubsystem subsystem) { return counters[(int) subsystem].allocations.load(memory_order_relaxed); }
+
+    // a report is requested every time the process gets SIGUSR1
+    static void enable_report_signal() { signal(SIGUSR1, on_report_signal); }
+
+    // 1 once after each SIGUSR1
+    static int take_report_request() {
+        return report_requested.load(memory_order_relaxed) && report_requested.exchange(0, memory_order_relaxed);
+    }
+
+    static void report(ostream &out) {
+#if !defined(MEMORY_ACCOUNTING)
+        out << "Memory accounting is off, build with -DMEMORY_ACCOUNTING" << endl;
+        return;
+#endif
+        for (int s = 0; s < (int) MemorySubsystem::count; ++s)
+            out << memory_subsystem_names[s] << ": Current: " << counters[s].current_bytes.load(memory_order_relaxed)
+                << " bytes, Peak: " << counters[s].peak_bytes.load(memory_order_relaxed)
+                << " bytes, Allocations: " << counters[s].allocations.load(memory_order_relaxed)
+                << ", Frees: " << counters[s].frees.load(memory_order_relaxed) << endl;
+        out << "Total: Current: " << total.current_bytes.load(memory_order_relaxed)
+            << " bytes, Peak: " << total.peak_bytes.load(memory_order_relaxed)
+            << " bytes, Allocations: " << total.allocations.load(memory_order_relaxed)
+            << ", Frees: " << total.frees.load(memory_order_relaxed) << endl;
+    }
+};
+
+MemoryCounters MemoryAccounting::counters[(int) MemorySubsystem::count];
+MemoryCounters MemoryAccounting::total;
+thread_local MemorySubsystem MemoryAccounting::current_subsystem = MemorySubsystem::other;
+atomic<int> MemoryAccounting::report_requested{0};
+
+// Allocations of this thread are charged to "subsystem" while the
+// scope is alive
+class MemoryScope {
+
+    MemorySubsystem previous;
+
+public:
+    MemoryScope(MemorySubsystem subsystem) {
+        this->previous = MemoryAccounting::current_subsystem;
+        MemoryAccounting::current_subsystem = subsystem;
+    }
+
+    MemoryScope(const MemoryScope &) = delete;
+    MemoryScope &operator=(const MemoryScope &) = delete;
+
+    ~MemoryScope() { MemoryAccounting::current_subsystem = this->previous; }
+};
+
+#if defined(MEMORY_ACCOUNTING)
+
+// Header in front of every block. Its size keeps the block aligned
+// for any fundamental type.
+union alignas(alignof(max_align_t)) AllocationHeader {
+    struct {
+        size_t bytes;
+        MemorySubsystem subsystem;
+    } info;
+    max_align_t align;
+};
+
+void *operator new(size_t bytes) {
+    AllocationHeader *header = (AllocationHeader *) malloc(sizeof(AllocationHeader) + bytes);
+    if (header == NULL)
+        throw bad_alloc();
+    header->info.bytes = bytes;
+    header->info.subsystem = MemoryAccounting::get_current_subsystem();
+    MemoryAccounting::record_allocation(header->info.subsystem, bytes);
+    return header + 1;
+}
+
+void operator delete(void *block) noexcept {
+    if (block == NULL)
+        return;
+    AllocationHeader *header = (AllocationHeader *) block - 1;
+    MemoryAccounting::record_free(header->info.subsystem, header->info.bytes);
+    free(header);
+}
+
+void *operator new[](size_t bytes) { return operator new(bytes); }
+void operator delete[](void *block) noexcept { operator delete(block); }
+void operator delete(void *block, size_t) noexcept { operator delete(block); }
+void operator delete[](void *block, size_t) noexcept { operator delete(block); }
+
+#endif
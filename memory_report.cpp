@@ -0,0 +1,45 @@
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//
+// Memory footprint report
+//
+// Prints the counters of MemoryAccounting, followed by the bytes
+// allocated for the delay line of every transmitter. A transmitter
+// whose buffer was freed for being idle shows 0 bytes, and its vector
+// is counted in the recycling bin instead.
+//
+// MemoryReportAtExit prints the report when it goes out of scope, so
+// it is printed whichever way main returns. It must be destroyed
+// before the output stream and the satellites.
+//
+// Requires Satellite (satellite.cpp) and MemoryAccounting
+// (memory_accounting.cpp).
+//
+
+void print_memory_footprint(ostream &out, vector<Satellite> &satellites) {
+    out << "Memory Report:" << indent << endl;
+    MemoryAccounting::report(out);
+    out << "Delay Line Capacity:" << indent << endl;
+    for (size_t s = 0; s < satellites.size(); ++s)
+        out << "Satellite " << s << ": " << satellites[s].get_buffer_bytes() << " bytes" << endl;
+    out << unindent << unindent;
+}
+
+class MemoryReportAtExit {
+
+    ostream &out;
+    vector<Satellite> &satellites;
+    int enabled;
+
+public:
+    MemoryReportAtExit(ostream &out_in, vector<Satellite> &satellites_in, int enabled_in)
+        : out(out_in), satellites(satellites_in), enabled(enabled_in) {}
+
+    ~MemoryReportAtExit() {
+        if (this->enabled)
+            print_memory_footprint(this->out, this->satellites);
+    }
+};
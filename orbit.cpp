@@ -76,21 +76,25 @@ double constexpr calc_exp(double base, int power) {
     }
     else if (power > 0) {
         ret = base;
-        for (int i = 0; i < power; ++i)
+        for (int i = 1; i < power; ++i)
         {
             ret *= base;
         }
     }
 
-    return base;
+    return ret;
 }
 
+// Gravitational Parameter of Earth , in m^3 / s^2
+double constexpr G_M_Earth = 3.986004418 * calc_exp(10, 14);
+double constexpr earth_radius = 6371000;  // mean radius, m
+double constexpr earth_rotation_rate = 7.2921159e-5;    // rad/s
+
 // Used to get a random velocity vector that is tangential to a a point on
 // a sphere concentric with the earth.
 tuple<double, double, double> get_random_tangential_velocity(double r, double a, double b, double c) {
 
     double v_x, v_y, v_z;
-    double constexpr G_M_Earth = 3.986004418 * calc_exp(10, 14); // Gravitational Parameter of Earth , in m^3 / s^2
     double v_orbit = sqrt(G_M_Earth / r);
  
     // generate random direction (x, y, z)
@@ -126,8 +130,6 @@ tuple<double, double, double> get_random_tangential_velocity(double r, double a,
 
 // calculate gravity vector based on satellite x, y, z position
 tuple<double, double, double> calc_gravity(tuple<double, double, double> sat_position) {
-    double constexpr G_M_Earth = 3.986004418 * calc_exp(10, 14); // Gravitational Parameter of Earth , in m^3 / s^2
-
     double x = -1 * get<0>(sat_position);
     double y = -1 * get<1>(sat_position);
     double z = -1 * get<2>(sat_position);
@@ -141,4 +143,87 @@ tuple<double, double, double> calc_gravity(tuple<double, double, double> sat_pos
     double g_z = z * (g / curr_magnitude);
 
     return tuple<double, double, double>{g_x, g_y, g_z};
-}
\ No newline at end of file
+}
+
+// convert (x, y, z) to (r, rho, theta)
+tuple<double, double, double> cartesian_to_spherical(tuple<double, double, double> pos_tuple) {
+
+    double x = get<0>(pos_tuple);
+    double y = get<1>(pos_tuple);
+    double z = get<2>(pos_tuple);
+
+    double r = sqrt(x * x + y * y + z * z);
+    double rho = atan(y / x);
+    double theta = acos(z / r);
+
+    return tuple<double, double, double> {r, rho, theta};
+}
+
+// Stumpff functions used by the universal variable Kepler solver
+double stumpff_c(double z) {
+    if (fabs(z) < 1e-6)
+        return 0.5 - z / 24;
+    if (z > 0)
+        return (1 - cos(sqrt(z))) / z;
+    return (cosh(sqrt(-z)) - 1) / (-z);
+}
+
+double stumpff_s(double z) {
+    if (fabs(z) < 1e-6)
+        return 1.0 / 6 - z / 120;
+    if (z > 0)
+        return (sqrt(z) - sin(sqrt(z))) / pow(sqrt(z), 3);
+    return (sinh(sqrt(-z)) - sqrt(-z)) / pow(sqrt(-z), 3);
+}
+
+// Advances a two body orbit around earth by "t" seconds in one step,
+// using the universal variable formulation of Kepler's equation.
+// pos (m) and vel (m/s) are updated in place.
+void kepler_advance(double pos[3], double vel[3], double t) {
+    double sqrt_mu = sqrt(G_M_Earth);
+    double r0 = sqrt(pos[0] * pos[0] + pos[1] * pos[1] + pos[2] * pos[2]);
+    double v0_sq = vel[0] * vel[0] + vel[1] * vel[1] + vel[2] * vel[2];
+    if (!(r0 > 0) || !isfinite(v0_sq) || t == 0)
+        return;
+
+    double vr0 = (pos[0] * vel[0] + pos[1] * vel[1] + pos[2] * vel[2]) / r0;
+    double alpha = 2 / r0 - v0_sq / G_M_Earth;  // reciprocal of semi major axis
+
+    // solve for universal anomaly chi with Newton's method
+    double chi = sqrt_mu * fabs(alpha) * t;
+    if (chi == 0)
+        chi = sqrt_mu * t / r0;
+    for (int i = 0; i < 50; ++i)
+    {
+        double z = alpha * chi * chi;
+        double c = stumpff_c(z);
+        double s = stumpff_s(z);
+        double f = r0 * vr0 / sqrt_mu * chi * chi * c + (1 - alpha * r0) * chi * chi * chi * s
+                   + r0 * chi - sqrt_mu * t;
+        double df = r0 * vr0 / sqrt_mu * chi * (1 - z * s) + (1 - alpha * r0) * chi * chi * c + r0;
+        double step = f / df;
+        chi -= step;
+        if (fabs(step) < 1e-10 * fabs(chi))
+            break;
+    }
+
+    // Lagrange f and g coefficients
+    double z = alpha * chi * chi;
+    double c = stumpff_c(z);
+    double s = stumpff_s(z);
+    double f = 1 - chi * chi / r0 * c;
+    double g = t - chi * chi * chi * s / sqrt_mu;
+
+    double r[3];
+    for (int i = 0; i < 3; ++i)
+        r[i] = f * pos[i] + g * vel[i];
+    double r_mag = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+
+    double f_dot = sqrt_mu / (r_mag * r0) * (z * chi * s - chi);
+    double g_dot = 1 - chi * chi / r_mag * c;
+    for (int i = 0; i < 3; ++i)
+    {
+        vel[i] = f_dot * pos[i] + g_dot * vel[i];
+        pos[i] = r[i];
+    }
+}
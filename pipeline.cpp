@@ -0,0 +1,213 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <cmath>
+#include "spsc_queue.cpp"
+
+using namespace std;
+
+//
+// Pipelined simulation engine
+//
+// Splits each time step into four stages that run on their own threads:
+//     orbit       - moves every satellite, snapshots positions
+//     tx          - generates audio and modulates it at the tx satellite
+//     propagation - pushes tx RF into the field, runs relays, reads the
+//                   RF at the rx satellite
+//     rx          - demodulates and prints the step
+// Stages exchange fixed size blocks of samples through lock free
+// single producer / single consumer queues, so consecutive blocks
+// overlap in different stages. Satellite 0 transmits, the last one
+// receives and the rest relay, as in main. Only single channel
+// satellites are supported.
+//
+// Requires Satellite (satellite.cpp), AudioSource (data_source.cpp),
+// WavFileSink (audio_file.cpp) and SimulationTrace (trace.cpp).
+//
+
+// block of samples passed between stages. Each stage fills its part.
+struct PipelineBlock {
+    int num_samples = 0;
+    vector<double> positions;   // x, y, z of every satellite, per sample
+    vector<double> tx_audio;
+    vector<double> tx_rf;
+    vector<double> rx_rf;
+    vector<double> rx_audio;
+
+    PipelineBlock(int block_size, int num_sats)
+        : positions(3 * num_sats * block_size), tx_audio(block_size), tx_rf(block_size),
+          rx_rf(block_size), rx_audio(block_size) {}
+};
+
+class PipelinedEngine {
+
+    vector<Satellite> &satellites;
+    SatellitePositions *sat_pos;        // positions used by RF
+    SatellitePositions orbit_pos;       // positions integrated by the orbit stage
+    AudioSource &wave_gen;
+    WavFileSink *audio_sink = NULL;     // optional, gets received audio
+    SimulationTrace *trace = NULL;      // optional, records every step
+    int num_sats;
+    int block_size;
+    long num_time_steps;
+    long num_blocks;
+
+    SpscQueue<PipelineBlock> orbit_queue;   // orbit -> propagation
+    SpscQueue<PipelineBlock> tx_queue;      // tx -> propagation
+    SpscQueue<PipelineBlock> rx_queue;      // propagation -> rx
+
+    int samples_in_block(long block) {
+        long remaining = this->num_time_steps - block * this->block_size;
+        return remaining < this->block_size ? remaining : this->block_size;
+    }
+
+    void orbit_stage() {
+        for (long b = 0; b < this->num_blocks; ++b)
+        {
+            PipelineBlock &block = this->orbit_queue.producer_slot();
+            block.num_samples = samples_in_block(b);
+            for (int i = 0; i < block.num_samples; ++i)
+            {
+                double *pos = &block.positions[3 * this->num_sats * i];
+                for (int s = 0; s < this->num_sats; ++s)
+                {
+                    this->satellites[s].move_one_frame();
+                    tie(pos[3 * s], pos[3 * s + 1], pos[3 * s + 2]) = this->orbit_pos.get_position(s);
+                }
+            }
+            this->orbit_queue.push();
+        }
+    }
+
+    void tx_stage() {
+        for (long b = 0; b < this->num_blocks; ++b)
+        {
+            PipelineBlock &block = this->tx_queue.producer_slot();
+            block.num_samples = samples_in_block(b);
+            for (int i = 0; i < block.num_samples; ++i)
+            {
+                block.tx_audio[i] = this->wave_gen.get_next();
+                block.tx_rf[i] = this->satellites[0].modulate(block.tx_audio[i]);
+            }
+            this->tx_queue.push();
+        }
+    }
+
+    void propagation_stage() {
+        int rx_sat = this->num_sats - 1;
+        for (long b = 0; b < this->num_blocks; ++b)
+        {
+            PipelineBlock &orbit_block = this->orbit_queue.consumer_slot();
+            PipelineBlock &tx_block = this->tx_queue.consumer_slot();
+            PipelineBlock &block = this->rx_queue.producer_slot();
+            block.num_samples = orbit_block.num_samples;
+
+            for (int i = 0; i < block.num_samples; ++i)
+            {
+                double *pos = &orbit_block.positions[3 * this->num_sats * i];
+                for (int s = 0; s < this->num_sats; ++s)
+                    this->sat_pos->set_position(s, pos[3 * s], pos[3 * s + 1], pos[3 * s + 2]);
+
+                this->satellites[0].propagate(tx_block.tx_rf[i]);
+                for (int j = 1; j < rx_sat; ++j)
+                    this->satellites[j].retransmit();
+                block.rx_rf[i] = this->satellites[rx_sat].receive_rf();
+            }
+
+            block.positions = orbit_block.positions;
+            block.tx_audio = tx_block.tx_audio;
+            block.tx_rf = tx_block.tx_rf;
+            this->orbit_queue.pop();
+            this->tx_queue.pop();
+            this->rx_queue.push();
+        }
+    }
+
+    void print_position(ostream &ins, const double *pos) {
+        tuple<double, double, double> sph = cartesian_to_spherical(tuple<double, double, double>{pos[0], pos[1], pos[2]});
+        ins << "r: " << get<0>(sph)
+            << " meters , rho: " << (180 / M_PI) * get<1>(sph)
+            << " degrees, theta: " << (180 / M_PI) * get<2>(sph)
+            << " degrees " << unindent << endl;
+    }
+
+    void rx_stage(ostream &ins) {
+        int rx_sat = this->num_sats - 1;
+        long step = 0;
+        for (long b = 0; b < this->num_blocks; ++b)
+        {
+            PipelineBlock &block = this->rx_queue.consumer_slot();
+            for (int i = 0; i < block.num_samples; ++i, ++step)
+            {
+                block.rx_audio[i] = this->satellites[rx_sat].demodulate(block.rx_rf[i]);
+                if (this->audio_sink != NULL)
+                    this->audio_sink->write(block.rx_audio[i]);
+
+                double *pos = &block.positions[3 * this->num_sats * i];
+                if (this->trace != NULL)
+                {
+                    this->trace->record_step(block.tx_audio[i], block.tx_rf[i], block.rx_rf[i], block.rx_audio[i]);
+                    this->trace->record_positions(pos, this->num_sats);
+                }
+
+                ins << "Time Step: " << step << indent << endl;
+                ins << "Transmitted Audio Sample: " << block.tx_audio[i] << endl;
+                ins << "Transmit Satellite Position: " << indent << endl;
+                print_position(ins, pos);
+                ins << "Transmitted RF Sample: " << block.tx_rf[i] << endl;
+                for (int j = 1; j < rx_sat; ++j)
+                {
+                    ins << "Satellite ID: "<< j <<  " Position: " << indent << endl;
+                    print_position(ins, pos + 3 * j);
+                }
+                ins << "Receive Satellite Position: " << indent << endl;
+                print_position(ins, pos + 3 * rx_sat);
+                ins << "Received RF Sample: " << block.rx_rf[i] << endl;
+                ins << "Received Audio Sample: " << block.rx_audio[i] << unindent << endl;
+            }
+            this->rx_queue.pop();
+        }
+    }
+
+public:
+    PipelinedEngine(vector<Satellite> &satellites_in, SatellitePositions *sat_pos_in, AudioSource &wave_gen_in, int block_size_in, int queue_depth = 4)
+        : satellites(satellites_in), orbit_pos(*sat_pos_in), wave_gen(wave_gen_in),
+          orbit_queue(queue_depth, PipelineBlock(block_size_in, satellites_in.size())),
+          tx_queue(queue_depth, PipelineBlock(block_size_in, satellites_in.size())),
+          rx_queue(queue_depth, PipelineBlock(block_size_in, satellites_in.size()))
+    {
+        this->sat_pos = sat_pos_in;
+        this->num_sats = satellites_in.size();
+        this->block_size = block_size_in;
+
+        // orbit stage integrates its own copy of the positions
+        for (int s = 0; s < this->num_sats; ++s)
+            this->satellites[s].set_orbit_positions(&this->orbit_pos);
+    }
+
+    void set_audio_sink(WavFileSink *audio_sink_in) { this->audio_sink = audio_sink_in; }
+    void set_trace(SimulationTrace *trace_in) { this->trace = trace_in; }
+
+    void run(long num_time_steps_in, ostream &ins) {
+        this->num_time_steps = num_time_steps_in;
+        this->num_blocks = (num_time_steps_in + this->block_size - 1) / this->block_size;
+
+        thread orbit_thread(&PipelinedEngine::orbit_stage, this);
+        thread tx_thread(&PipelinedEngine::tx_stage, this);
+        thread propagation_thread(&PipelinedEngine::propagation_stage, this);
+        thread rx_thread(&PipelinedEngine::rx_stage, this, ref(ins));
+
+        orbit_thread.join();
+        tx_thread.join();
+        propagation_thread.join();
+        rx_thread.join();
+
+        // hand orbit back to the shared positions
+        for (int s = 0; s < this->num_sats; ++s)
+        {
+            this->satellites[s].set_orbit_positions(this->sat_pos);
+            this->sat_pos->set_position(s, get<0>(this->orbit_pos.get_position(s)),
+                get<1>(this->orbit_pos.get_position(s)), get<2>(this->orbit_pos.get_position(s)));
+        }
+    }
+};
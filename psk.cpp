@@ -0,0 +1,243 @@
+#include <complex>
+#include <cmath>
+
+using namespace std;
+
+//
+// Building blocks of the PSK modems
+//
+// Transmitters send a PRBS-15 test pattern (x^15 + x^14 + 1), so
+// receivers can count bit errors without a copy of the data: a
+// PrbsChecker loads its register from the received bits and from then
+// on predicts every bit. A bit that doesn't match is an error.
+//
+// BPSK maps bit b to 1 - 2b. QPSK maps bits (b0, b1) to
+// ((1 - 2 b0) + j (1 - 2 b1)) / sqrt(2).
+//
+
+// symbols per second of a PSK carrier at "frequency"
+double psk_symbol_rate(double frequency) { return frequency / 10; }
+
+// next bit of a PRBS-15 generator with state "state" (not 0)
+inline int prbs15_next(unsigned &state) {
+    int bit = ((state >> 14) ^ (state >> 13)) & 1;
+    state = ((state << 1) | bit) & 0x7fff;
+    return bit;
+}
+
+inline complex<double> psk_map(int bits_per_symbol, int b0, int b1) {
+    if (bits_per_symbol == 1)
+        return complex<double>(1 - 2 * b0, 0);
+    return complex<double>((1 - 2 * b0) * M_SQRT1_2, (1 - 2 * b1) * M_SQRT1_2);
+}
+
+// nearest constellation point
+inline complex<double> psk_decide(int bits_per_symbol, complex<double> symbol) {
+    if (bits_per_symbol == 1)
+        return complex<double>(symbol.real() < 0 ? -1 : 1, 0);
+    return complex<double>(symbol.real() < 0 ? -M_SQRT1_2 : M_SQRT1_2, symbol.imag() < 0 ? -M_SQRT1_2 : M_SQRT1_2);
+}
+
+// Self synchronizing PRBS-15 checker
+class PrbsChecker {
+
+    unsigned state = 0;     // last 15 bits
+    int loaded = 0;         // bits shifted in while acquiring
+    int matches = 0;        // consecutive correct predictions while acquiring
+    int locked = 0;
+    int window_bits = 0;
+    int window_errors = 0;
+
+    static const int lock_matches = 32;
+    // more than max_window_errors errors in window_size bits means
+    // the pattern was lost (e.g. a cycle slip), and the checker
+    // acquires again
+    static const int window_size = 256;
+    static const int max_window_errors = 64;
+
+public:
+    // Returns -1 while acquiring, otherwise 1 if "bit" is an error
+    // and 0 if it is correct
+    int push(int bit) {
+        int predicted = ((this->state >> 14) ^ (this->state >> 13)) & 1;
+        if (!this->locked)
+        {
+            // an all zero register predicts silence
+            if (this->loaded >= 15 && this->state != 0 && bit == predicted)
+                this->matches++;
+            else
+                this->matches = 0;
+            this->state = ((this->state << 1) | bit) & 0x7fff;
+            this->loaded++;
+            if (this->matches >= lock_matches)
+            {
+                this->locked = 1;
+                this->window_bits = 0;
+                this->window_errors = 0;
+            }
+            return -1;
+        }
+
+        // errors don't enter the register
+        this->state = ((this->state << 1) | predicted) & 0x7fff;
+        int error = bit != predicted;
+        this->window_errors += error;
+        if (++this->window_bits == window_size)
+        {
+            if (this->window_errors > max_window_errors)
+                reset();
+            this->window_bits = 0;
+            this->window_errors = 0;
+        }
+        return error;
+    }
+
+    void reset() {
+        this->state = 0;
+        this->loaded = 0;
+        this->matches = 0;
+        this->locked = 0;
+    }
+
+    int is_locked() { return this->locked; }
+};
+
+// Counts bit errors of hard PSK decisions. A carrier recovered from
+// the signal itself can lock at any rotation of the constellation
+// (2 for BPSK, 4 for QPSK), so one checker runs per rotation until one
+// of them locks. Bits are only counted while locked.
+class BitErrorCounter {
+
+    int bits_per_symbol;
+    int num_rotations;
+    PrbsChecker checkers[4];
+    int locked_rotation = -1;
+    long bits = 0;
+    long bit_errors = 0;
+
+public:
+    BitErrorCounter(int bits_per_symbol_in) {
+        this->bits_per_symbol = bits_per_symbol_in;
+        this->num_rotations = bits_per_symbol_in == 1 ? 2 : 4;
+    }
+
+    void push(complex<double> decision) {
+        complex<double> rotation = 1;
+        complex<double> step = this->num_rotations == 2 ? complex<double>(-1, 0) : complex<double>(0, 1);
+        for (int r = 0; r < this->num_rotations; ++r, rotation *= step)
+        {
+            if (this->locked_rotation >= 0 && r != this->locked_rotation)
+                continue;
+            complex<double> rotated = decision * rotation;
+            int result = this->checkers[r].push(rotated.real() < 0);
+            if (result >= 0)
+            {
+                this->bits++;
+                this->bit_errors += result;
+            }
+            if (this->bits_per_symbol == 2)
+            {
+                result = this->checkers[r].push(rotated.imag() < 0);
+                if (result >= 0)
+                {
+                    this->bits++;
+                    this->bit_errors += result;
+                }
+            }
+
+            if (this->locked_rotation < 0 && this->checkers[r].is_locked())
+                this->locked_rotation = r;
+            else if (this->locked_rotation == r && !this->checkers[r].is_locked())
+            {
+                // lost lock, acquire again at every rotation
+                this->locked_rotation = -1;
+                for (int k = 0; k < this->num_rotations; ++k)
+                    this->checkers[k].reset();
+                break;
+            }
+        }
+    }
+
+    long get_bits() { return this->bits; }
+    long get_bit_errors() { return this->bit_errors; }
+    double get_bit_error_rate() { return this->bits > 0 ? (double) this->bit_errors / this->bits : 0; }
+    int is_locked() { return this->locked_rotation >= 0; }
+};
+
+// Coherent PSK detector for a complex baseband stream. The matched
+// filter of the rectangular symbols is an integrate and dump over each
+// symbol. Symbol timing is recovered with a Gardner detector, which
+// compares the integral over the second half of one symbol and the
+// first half of the next with the difference of the two symbols, and
+// moves the next window by a sample once the accumulated error is a
+// whole sample. The carrier phase is recovered with a decision
+// directed Costas loop.
+class PskDetector {
+
+    int bits_per_symbol;
+    int samples_per_symbol;
+    int window_length;          // samples in the current window
+    int sample_in_window = 0;
+    complex<double> half_sums[2];
+    complex<double> previous_second_half = 0;
+    complex<double> previous_symbol = 0;
+    complex<double> symbol = 0;
+    complex<double> decision = 1;
+    double phase = 0;           // carrier phase estimate, rad
+    double timing_error = 0;    // samples the windows lag the symbols
+
+    static constexpr double carrier_loop_gain = 0.1;
+    static constexpr double timing_loop_gain = 0.05;
+
+public:
+    PskDetector(int bits_per_symbol_in = 1, int samples_per_symbol_in = 1) {
+        this->bits_per_symbol = bits_per_symbol_in;
+        this->samples_per_symbol = samples_per_symbol_in;
+        this->window_length = samples_per_symbol_in;
+    }
+
+    // Pushes one baseband sample. Returns 1 when a symbol is complete.
+    int push(complex<double> sample) {
+        this->half_sums[2 * this->sample_in_window >= this->window_length] += sample;
+        if (++this->sample_in_window < this->window_length)
+            return 0;
+
+        complex<double> derotate = polar(1.0 / this->window_length, -this->phase);
+        complex<double> first_half = this->half_sums[0] * derotate;
+        complex<double> second_half = this->half_sums[1] * derotate;
+        this->symbol = first_half + second_half;
+        this->decision = psk_decide(this->bits_per_symbol, this->symbol);
+
+        // Gardner timing error. The middle integral vanishes at a
+        // symbol change when the windows are aligned.
+        complex<double> middle = this->previous_second_half + first_half;
+        double energy = norm(this->previous_symbol) + norm(this->symbol);
+        if (energy > 0)
+            this->timing_error -= timing_loop_gain * real(middle * conj(this->previous_symbol - this->symbol)) / energy * this->samples_per_symbol / 2;
+        this->window_length = this->samples_per_symbol;
+        if (this->timing_error >= 1)
+        {
+            this->window_length--;
+            this->timing_error -= 1;
+        }
+        else if (this->timing_error <= -1)
+        {
+            this->window_length++;
+            this->timing_error += 1;
+        }
+
+        this->phase = remainder(this->phase + carrier_loop_gain * arg(this->symbol * conj(this->decision)), 2 * M_PI);
+
+        this->previous_second_half = second_half;
+        this->previous_symbol = this->symbol;
+        this->half_sums[0] = 0;
+        this->half_sums[1] = 0;
+        this->sample_in_window = 0;
+        return 1;
+    }
+
+    // matched filter output and decision of the last symbol
+    complex<double> get_symbol() { return this->symbol; }
+    complex<double> get_decision() { return this->decision; }
+    double get_phase() { return this->phase; }
+};
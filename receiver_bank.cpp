@@ -0,0 +1,192 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+using namespace std;
+
+//
+// Receiver bank
+//
+// Demodulates many receivers at once. Oscillator, filter and time
+// state of every receiver is kept in separate arrays (one lane per
+// receiver), so advancing all receivers by one sample is a branch free
+// loop over lanes that the compiler vectorizes. The per sample sin of
+// RxAMProcessing / RxFMProcessing is replaced by a rotating phasor,
+// which is re-synchronized to sin(2 * pi * f * t) every sync_interval
+// samples so rounding errors don't accumulate.
+//
+// All lanes of a bank use the same demodulation.
+//
+
+enum class Demodulation { none, am, fm };
+
+template<typename T>
+class BasicReceiverBank {
+
+    Demodulation demodulation = Demodulation::none;
+    int num_lanes = 0;
+    int sync_interval;
+    int steps_since_sync = 0;
+
+    // one entry per lane. Oscillator 1 is only used by FM. Time and
+    // frequency stay double for the resync, the phasors are T so every
+    // per sample loop runs on T.
+    vector<double> time;
+    vector<double> dt;
+    vector<double> frequency[2];
+    vector<T> osc_sin[2];
+    vector<T> osc_cos[2];
+    vector<T> rot_sin[2];     // rotation per sample
+    vector<T> rot_cos[2];
+    vector<T> lpf_output[2];
+    vector<T> e_pow;
+    vector<unsigned char> all_active;
+
+    int add_lane(Demodulation demodulation_in, double dt_in, double time_in, double f0, double f1) {
+        if (this->demodulation != Demodulation::none && this->demodulation != demodulation_in)
+            return -1;
+        this->demodulation = demodulation_in;
+
+        this->time.push_back(time_in);
+        this->dt.push_back(dt_in);
+        double f[2] = {f0, f1};
+        for (int k = 0; k < 2; ++k)
+        {
+            this->frequency[k].push_back(f[k]);
+            this->osc_sin[k].push_back(sin(2 * M_PI * f[k] * time_in));
+            this->osc_cos[k].push_back(cos(2 * M_PI * f[k] * time_in));
+            this->rot_sin[k].push_back(sin(2 * M_PI * f[k] * dt_in));
+            this->rot_cos[k].push_back(cos(2 * M_PI * f[k] * dt_in));
+            this->lpf_output[k].push_back(0);
+        }
+        // low pass filter with bandwidth of 2*pi*10000 Hz, as in the
+        // rx processors
+        this->e_pow.push_back(1 - exp(-dt_in * 2 * M_PI * 10000));
+        this->all_active.push_back(1);
+        return this->num_lanes++;
+    }
+
+    // sets oscillators to their exact value at the current time
+    void sync_oscillators() {
+        int num_osc = this->demodulation == Demodulation::fm ? 2 : 1;
+        for (int k = 0; k < num_osc; ++k)
+            for (int l = 0; l < this->num_lanes; ++l)
+            {
+                this->osc_sin[k][l] = sin(2 * M_PI * this->frequency[k][l] * this->time[l]);
+                this->osc_cos[k][l] = cos(2 * M_PI * this->frequency[k][l] * this->time[l]);
+            }
+        this->steps_since_sync = 0;
+    }
+
+    // rotates oscillator k of every lane by one sample
+    void advance_oscillator(int k) {
+        T *s = this->osc_sin[k].data();
+        T *c = this->osc_cos[k].data();
+        const T *rs = this->rot_sin[k].data();
+        const T *rc = this->rot_cos[k].data();
+        for (int l = 0; l < this->num_lanes; ++l)
+        {
+            T next_sin = s[l] * rc[l] + c[l] * rs[l];
+            c[l] = c[l] * rc[l] - s[l] * rs[l];
+            s[l] = next_sin;
+        }
+    }
+
+public:
+    BasicReceiverBank(int sync_interval_in = 1024) { this->sync_interval = sync_interval_in; }
+
+    // lanes start at time "time_in" with an empty filter.
+    // Returns the lane, or -1 if the bank demodulates something else.
+    int add_am_lane(double frequency_in, double dt_in, double time_in) {
+        return add_lane(Demodulation::am, dt_in, time_in, frequency_in, 0);
+    }
+
+    int add_fm_lane(double frequency_in, double dt_in, double time_in, double dev) {
+        return add_lane(Demodulation::fm, dt_in, time_in, frequency_in + dev / 2, frequency_in - dev / 2);
+    }
+
+    int get_num_lanes() { return this->num_lanes; }
+
+    // Advances every lane by one sample. rf_in and audio_out hold one
+    // sample per lane. Lanes with active[l] == 0 keep their filter
+    // state and only advance in time, like a skipped receiver. active
+    // can be NULL when every lane is active.
+    void process(const double *rf_in, const unsigned char *active, T *audio_out) {
+        if (this->steps_since_sync == this->sync_interval)
+            sync_oscillators();
+        this->steps_since_sync++;
+
+        if (active == NULL)
+            active = this->all_active.data();
+        int n = this->num_lanes;
+        const T *e_pow_lane = this->e_pow.data();
+        T *lpf0 = this->lpf_output[0].data();
+        const T *osc0 = this->osc_sin[0].data();
+        if (this->demodulation == Demodulation::am)
+        {
+            for (int l = 0; l < n; ++l)
+            {
+                T mask = active[l];
+                T shifted_signal = rf_in[l] * osc0[l];
+                lpf0[l] += (100 * shifted_signal - lpf0[l]) * e_pow_lane[l] * mask;
+                audio_out[l] = lpf0[l];
+            }
+        }
+        else if (this->demodulation == Demodulation::fm)
+        {
+            // same as RxFMProcessing: difference of two AM demodulators
+            // at each end of the band
+            T *lpf1 = this->lpf_output[1].data();
+            const T *osc1 = this->osc_sin[1].data();
+            for (int l = 0; l < n; ++l)
+            {
+                T mask = active[l];
+                lpf0[l] += (100 * osc0[l] - lpf0[l]) * e_pow_lane[l] * mask;
+                lpf1[l] += (100 * osc1[l] - lpf1[l]) * e_pow_lane[l] * mask;
+                audio_out[l] = lpf1[l] - lpf0[l];
+            }
+            advance_oscillator(1);
+        }
+        advance_oscillator(0);
+
+        double *time_lane = this->time.data();
+        const double *dt_lane = this->dt.data();
+        for (int l = 0; l < n; ++l)
+            time_lane[l] += dt_lane[l];
+    }
+
+    // Advances every lane by n samples without processing anything,
+    // like a receiver's skip_time
+    void skip(long n) {
+        for (int l = 0; l < this->num_lanes; ++l)
+            this->time[l] += n * this->dt[l];
+        sync_oscillators();
+    }
+
+    // n samples of every lane. rf_in and audio_out are time step
+    // major: sample k of lane l is at [k * num_lanes + l].
+    void process_block(const double *rf_in, T *audio_out, int n) {
+        for (int k = 0; k < n; ++k)
+            process(rf_in + k * this->num_lanes, NULL, audio_out + k * this->num_lanes);
+    }
+};
+
+using ReceiverBank = BasicReceiverBank<dsp_sample_t>;
+
+// Adds a lane for the visited rx processor to a receiver bank. "lane"
+// is -1 if the processor type is not supported by the bank.
+struct AddReceiverBankLane : RxProcessingVisitor {
+    ReceiverBank &bank;
+    mutable int lane = -1;
+
+    AddReceiverBankLane(ReceiverBank &bank_in) : bank(bank_in) {}
+
+    virtual void visit(RxProcessing &) const override { this->lane = -1; }
+    virtual void visit(RxAMProcessing & proc) const override {
+        this->lane = this->bank.add_am_lane(proc.get_frequency(), proc.get_dt(), proc.get_time());
+    }
+    virtual void visit(RxFMProcessing & proc) const override {
+        this->lane = this->bank.add_fm_lane(proc.get_frequency(), proc.get_dt(), proc.get_time(), proc.get_dev());
+    }
+    virtual void visit(RxPSKProcessing &) const override { this->lane = -1; }
+};
@@ -1,7 +1,11 @@
 #include <iostream>
 #include <vector>
+#include <climits>
+#include "memory_accounting.cpp"
 #include "em_field.cpp"
 #include "rf_buffer.cpp"
+#include "channel.cpp"
+#include "antenna.cpp"
 
 using namespace std;
 
@@ -34,15 +38,19 @@ public:
 };
 
 // abstract transmitting RF class
-class RFTx : RF
+// T is the sample type stored in the delay line
+template<typename T>
+class BasicRFTx : RF
 {
 
     // Buffers the signal to be transmitted.
     // This is needed to due latency between transmission
     // and time that another satellite receives signal.
     // The buffer is represented using a reyclable vector.
-    RecycledRFBuffer<double>* rf_buffer;
-    double buffer_max_size;
+    RecycledRFBuffer<T>* rf_buffer;
+    double scale = 0;   // full scale of fixed point samples in rf_buffer
+    double buffer_max_size;     // time steps of the longest link
+    int max_block_size = 1;     // longest block pushed so far
     SatellitePositions *sat_pos;
     // time step size
     double dt;
@@ -50,33 +58,75 @@ class RFTx : RF
     double time_steps_no_signal = 0;
     double max_time_steps_no_signal;
     double sig_thresh = 1e-20; // if no signal above this for some amount of time, delete buffer
+    long steps_since_signal = LONG_MAX / 2;  // time steps since |signal| was above sig_thresh
+    long num_steps = 0;     // time steps transmitted so far
+    ChannelImpairments *channel = NULL;     // optional noise on every link
+    const LinkGains *link_gains = NULL;     // optional antenna gain of every link
+
+    // antenna gain of the link to rx_sat_id, 1 without antennas
+    double link_gain(int rx_sat_id) { return this->link_gains == NULL ? 1 : this->link_gains->get(get_sat_id(), rx_sat_id); }
+
+    // Adds "count" samples starting at buffer index "first", received
+    // at rx_sat_id at time steps step .. step + count - 1, through the
+    // channel impairments
+    void add_impaired(int rx_sat_id, long step, int first, int count, double loss, double *out) {
+        const int chunk_size = 256;
+        double rf[chunk_size], rf_quadrature[chunk_size];
+        int quarter_period = this->channel->get_quarter_period();
+        int phase_noise = this->channel->has_phase_noise();
+        for (int start = 0; start < count; start += chunk_size)
+        {
+            int m = count - start < chunk_size ? count - start : chunk_size;
+            for (int k = 0; k < m; ++k)
+            {
+                int idx = first + start + k;
+                rf[k] = SampleCodec<T>::decode((*rf_buffer)[idx], this->scale);
+                rf_quadrature[k] = phase_noise && idx >= quarter_period ? SampleCodec<T>::decode((*rf_buffer)[idx - quarter_period], this->scale) : 0;
+            }
+            this->channel->add_block(get_sat_id(), rx_sat_id, step + start, rf, rf_quadrature, loss, link_gain(rx_sat_id), out + start, m);
+        }
+    }
 
     double calc_field_at_satellite(SatellitePositions *sat_pos, int rx_sat_id) {
         // update electric field of other satellite base on current satellite's 
         // previous transmissions
 
+        // buffer is freed while transmitter is inactive
+        if (rf_buffer == NULL)
+            return 0;
+
         double distance = sat_pos->calc_distance(get_sat_id(), rx_sat_id);
         double time_to_rx_sat = distance / get_c();
         int sig_buff_size = rf_buffer->size();
 
         int time_steps_to_rx_sat = (int) round(time_to_rx_sat / get_dt());
 
-        if (time_steps_to_rx_sat > sig_buff_size)
+        if (time_steps_to_rx_sat < 0 || time_steps_to_rx_sat >= sig_buff_size)
             // signal hasn't reached satellite
             return 0;
 
-        // resize buffer once it gets too large
-        if (sig_buff_size > this->buffer_max_size)
-            rf_buffer->resize(round(0.85 * sig_buff_size));
+        if (this->channel != NULL)
+        {
+            double signal_at_rx = 0;
+            add_impaired(rx_sat_id, this->num_steps - 1, sig_buff_size - time_steps_to_rx_sat - 1, 1, propagation_loss(distance), &signal_at_rx);
+            return signal_at_rx;
+        }
 
         // get value of electric field and calculate loss
-        double signal_at_rx_raw = (*rf_buffer)[sig_buff_size - time_steps_to_rx_sat - 1];
-        signal_at_rx_raw = signal_at_rx_raw * propagation_loss(distance);
+        double signal_at_rx_raw = SampleCodec<T>::decode((*rf_buffer)[sig_buff_size - time_steps_to_rx_sat - 1], this->scale);
+        signal_at_rx_raw = signal_at_rx_raw * propagation_loss(distance) * link_gain(rx_sat_id);
 
         return signal_at_rx_raw;
 
     }
 
+    void track_signal(double in_signal) {
+        if (fabs(in_signal) > this->sig_thresh)
+            this->steps_since_signal = 0;
+        else
+            this->steps_since_signal++;
+    }
+
     void check_buffer_activity(double in_signal) {
         // Checks if rf buffer has been updated with
         // any signal above a threshold recently. If not,
@@ -99,12 +149,41 @@ class RFTx : RF
         {
             time_steps_no_signal = 0;
             if (rf_buffer == NULL)
-                rf_buffer = new RecycledRFBuffer<double>();
+            {
+                new_buffer();
+            }
         }
     }
 
+    // Samples a read can reach back: the longest link, plus a block
+    // for block reads of samples that are already pushed, plus the
+    // quadrature tap of the phase noise
+    int delay_line_length() {
+        int quarter_period = this->channel != NULL && this->channel->has_phase_noise() ? this->channel->get_quarter_period() : 0;
+        return (int) ceil(this->buffer_max_size) + this->max_block_size + quarter_period;
+    }
+
+    void new_buffer() {
+        MemoryScope scope(MemorySubsystem::delay_lines);
+        rf_buffer = new RecycledRFBuffer<T>();
+        rf_buffer->set_max_size(delay_line_length());
+    }
+
+    // Appends a sample to the delay line. Fixed point delay lines
+    // grow their scale (and rescale stored samples) when needed.
+    void push_sample(double in_signal) {
+        if (SampleCodec<T>::is_fixed && fabs(in_signal) > this->scale)
+        {
+            double new_scale = fixed_point_scale_for(in_signal);
+            for (int i = 0; i < rf_buffer->size(); ++i)
+                rf_buffer->set(i, SampleCodec<T>::encode(SampleCodec<T>::decode((*rf_buffer)[i], this->scale), new_scale));
+            this->scale = new_scale;
+        }
+        rf_buffer->push_back(SampleCodec<T>::encode(in_signal, this->scale));
+    }
+
 public:
-    explicit RFTx(EMField * em_field_in, int sat_id, SatellitePositions * sat_pos, double dt_in) : RF(em_field_in, sat_id) {
+    explicit BasicRFTx(EMField * em_field_in, int sat_id, SatellitePositions * sat_pos, double dt_in) : RF(em_field_in, sat_id) {
         this->sat_pos = sat_pos;
         this->dt = dt_in;
         // Create RF buffer.
@@ -114,7 +193,9 @@ public:
         // between two satellites.
         this->buffer_max_size = 20000000 / (this->c * this->dt);
         this->max_time_steps_no_signal = this->buffer_max_size;
-        rf_buffer = new RecycledRFBuffer<double>();
+        // the delay line is a ring of delay_line_length samples, so
+        // only samples too old to reach any satellite are overwritten
+        new_buffer();
     }
 
     // Takes input signal and updates RF signal at 
@@ -122,8 +203,10 @@ public:
     // represents the transmitted signal.
     void update_field(double in_signal) {
 
+        this->num_steps++;
         if (rf_buffer != NULL)
-            rf_buffer->push_back(in_signal);
+            push_sample(in_signal);
+        track_signal(in_signal);
 
         // free buffer is no signal received in a while
         check_buffer_activity(in_signal);
@@ -138,22 +221,178 @@ public:
             get_em_field()->set_field(rx_sat_id, get_sat_id(), calc_field_at_satellite(sat_pos, rx_sat_id));
         }
     }
+
+    // Block version of the buffer update in update_field. Appends n
+    // transmitted samples. The field is not written to EMField, block
+    // engines read it with add_field_block_at_satellite instead.
+    void push_block(const double *in_signal, int n) {
+        if (n > this->max_block_size)
+        {
+            this->max_block_size = n;
+            if (rf_buffer != NULL)
+                rf_buffer->set_max_size(delay_line_length());
+        }
+        this->num_steps += n;
+        for (int k = 0; k < n; ++k)
+        {
+            if (rf_buffer != NULL)
+                push_sample(in_signal[k]);
+            track_signal(in_signal[k]);
+            check_buffer_activity(in_signal[k]);
+        }
+    }
+
+    // Adds the field of this transmitter at satellite rx_sat_id for the
+    // n time steps of the current block to "out". "pushed" is 1 if
+    // this transmitter's samples for the block are already in the
+    // buffer. Distance is only evaluated once per block.
+    void add_field_block_at_satellite(int rx_sat_id, double *out, int n, int pushed) {
+        if (rf_buffer == NULL)
+            return;
+
+        double distance = get_sat_pos()->calc_distance(get_sat_id(), rx_sat_id);
+        double loss = propagation_loss(distance);
+        int time_steps_to_rx_sat = link_latency(rx_sat_id);
+        int sig_buff_size = rf_buffer->size();
+        int start = pushed ? sig_buff_size - n : sig_buff_size;
+
+        if (this->channel != NULL)
+        {
+            // samples that have reached the satellite are contiguous
+            int k_begin = time_steps_to_rx_sat - start > 0 ? time_steps_to_rx_sat - start : 0;
+            int k_end = sig_buff_size + time_steps_to_rx_sat - start < n ? sig_buff_size + time_steps_to_rx_sat - start : n;
+            long first_step = pushed ? this->num_steps - n : this->num_steps;
+            if (k_begin < k_end)
+                add_impaired(rx_sat_id, first_step + k_begin, start + k_begin - time_steps_to_rx_sat, k_end - k_begin, loss, out + k_begin);
+            return;
+        }
+
+        loss *= link_gain(rx_sat_id);
+        for (int k = 0; k < n; ++k)
+        {
+            int idx = start + k - time_steps_to_rx_sat;
+            // signal hasn't reached satellite
+            if (idx < 0 || idx >= sig_buff_size)
+                continue;
+            out[k] += SampleCodec<T>::decode((*rf_buffer)[idx], this->scale) * loss;
+        }
+    }
+
+    // Field this transmitter causes at a point (x, y, z) that isn't a
+    // satellite, e.g. a ground station. Same as the field at a
+    // satellite, without resizing the buffer.
+    double calc_field_at_point(double x, double y, double z) {
+        if (rf_buffer == NULL)
+            return 0;
+
+        double sat_x, sat_y, sat_z;
+        tie(sat_x, sat_y, sat_z) = get_sat_pos()->get_position(get_sat_id());
+        double distance = sqrt((x - sat_x) * (x - sat_x) + (y - sat_y) * (y - sat_y) + (z - sat_z) * (z - sat_z));
+        int sig_buff_size = rf_buffer->size();
+        int time_steps_to_point = (int) round(distance / get_c() / get_dt());
+        if (time_steps_to_point < 0 || time_steps_to_point >= sig_buff_size)
+            // signal hasn't reached point
+            return 0;
+        return SampleCodec<T>::decode((*rf_buffer)[sig_buff_size - time_steps_to_point - 1], this->scale) * propagation_loss(distance);
+    }
+
+    // number of time steps for signal to reach satellite rx_sat_id
+    int link_latency(int rx_sat_id) {
+        double distance = get_sat_pos()->calc_distance(get_sat_id(), rx_sat_id);
+        return (int) round(distance / get_c() / get_dt());
+    }
+
+    // 1 if everything this transmitter sent has passed every
+    // other satellite, so it no longer affects any receiver
+    int is_drained() {
+        SatellitePositions *sat_pos = get_sat_pos();
+        for (int rx_sat_id = 0; rx_sat_id < sat_pos->get_num_sats(); ++rx_sat_id)
+            if (rx_sat_id != get_sat_id() && this->steps_since_signal <= link_latency(rx_sat_id))
+                return 0;
+        return 1;
+    }
+
+    // number of other satellites that signal sent by this transmitter
+    // is still on its way to
+    int count_active_links() {
+        SatellitePositions *sat_pos = get_sat_pos();
+        int active_links = 0;
+        for (int rx_sat_id = 0; rx_sat_id < sat_pos->get_num_sats(); ++rx_sat_id)
+            if (rx_sat_id != get_sat_id() && this->steps_since_signal <= link_latency(rx_sat_id))
+                active_links++;
+        return active_links;
+    }
+
+    // bytes allocated for the delay line
+    size_t get_buffer_bytes() { return rf_buffer == NULL ? 0 : rf_buffer->capacity() * sizeof(T); }
+
+    // Skips n time steps of silence without pushing them into the
+    // buffer. Only valid while the transmitter is drained: nothing in
+    // the buffer can still reach a receiver (that would take a link
+    // growing faster than light), so it is cleared. Reads after the
+    // skip see silence until new samples are pushed.
+    void skip_silence(long n) {
+        this->num_steps += n;
+        this->steps_since_signal += n;
+        this->time_steps_no_signal += n;
+        if (rf_buffer == NULL)
+            return;
+        if (this->time_steps_no_signal >= this->max_time_steps_no_signal)
+        {
+            delete rf_buffer;
+            rf_buffer = NULL;
+        }
+        else
+            rf_buffer->clear();
+    }
+
+    // noise and phase noise are added to every link from now on
+    void set_channel(ChannelImpairments *channel_in) {
+        this->channel = channel_in;
+        if (rf_buffer != NULL)
+            rf_buffer->set_max_size(delay_line_length());
+    }
+
+    // links are multiplied by the antenna gains of "link_gains_in"
+    // from now on
+    void set_link_gains(const LinkGains *link_gains_in) { this->link_gains = link_gains_in; }
+
     SatellitePositions *get_sat_pos() { return this->sat_pos; }
     double get_c() { return this->c; };
     double get_dt() { return this->dt; };
 
-    ~RFTx() { delete rf_buffer; }
+    ~BasicRFTx() { delete rf_buffer; }
 };
 
+using RFTx = BasicRFTx<rf_sample_t>;
+
 // abstract receiving RF class
 // used to get the value of RF at
 // a given satellite's receiver
 class RFRx : RF
 {
+    ChannelImpairments *channel = NULL;     // optional receiver noise
+    long num_steps = 0;     // time steps received so far
+
 public:
     explicit RFRx(EMField * em_field_in, int sat_id) : RF(em_field_in, sat_id) {}
     double get_field() {
         double field = get_em_field()->get_field(get_sat_id());
+        add_noise(&field, 1);
         return field;
     }
+
+    // Adds the receiver noise of the next n time steps to "field",
+    // for engines that sum the field themselves
+    void add_noise(double *field, int n) {
+        if (this->channel != NULL)
+            this->channel->add_receiver_noise(get_sat_id(), this->num_steps, field, n);
+        this->num_steps += n;
+    }
+
+    // skips n time steps
+    void skip(long n) { this->num_steps += n; }
+
+    // receiver noise is added every time step from now on
+    void set_channel(ChannelImpairments *channel_in) { this->channel = channel_in; }
 };
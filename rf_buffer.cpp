@@ -1,5 +1,6 @@
 #include <vector>
 #include <stack>
+#include <algorithm>
 
 using namespace std;
 
@@ -14,6 +15,9 @@ using namespace std;
 // of vectors to optimize the chance of cache hits 
 // and to create vectors with the correct size.
 //
+// With a maximum size the buffer is a ring: once full, every push
+// overwrites the oldest sample. Index 0 is always the oldest sample.
+//
 
 
 // Recycling Bin Implementation
@@ -34,14 +38,18 @@ public:
 
 	void add_vector(vector<T> in_vect)
 	{
+		MemoryScope scope(MemorySubsystem::recycling_bin);
+		MemoryAccounting::transfer(MemorySubsystem::delay_lines, MemorySubsystem::recycling_bin, in_vect.capacity() * sizeof(T));
 		vectors.push(move(in_vect));
 		is_empty = 0;
 	}
 
 	vector<T> get_vector()
 	{		
-		vector<T> temp = vectors.top();
+		// moved out, so the vector keeps its capacity
+		vector<T> temp = move(vectors.top());
 		vectors.pop();
+		MemoryAccounting::transfer(MemorySubsystem::recycling_bin, MemorySubsystem::delay_lines, temp.capacity() * sizeof(T));
 		if (vectors.empty())
 			is_empty = 1;
 		return temp;
@@ -64,6 +72,7 @@ public:
 
 	static RFBufferRecyclingBinData<T>* get_instance(){
 		if (data == NULL){
+			MemoryScope scope(MemorySubsystem::recycling_bin);
 			data = new RFBufferRecyclingBinData<T>();
 		} 
 		return data;
@@ -79,11 +88,20 @@ class RecycledRFBuffer
 
 	vector<T> vect;
 	RFBufferRecyclingBinData<T> * recycling_bin;
+	int head = 0;		// position of the oldest sample in vect
+	int max_size = 0;	// 0 is unbounded
+
+	int position(int idx)
+	{
+		int pos = head + idx;
+		return pos < (int) vect.size() ? pos : pos - (int) vect.size();
+	}
 
 public:
 
 	RecycledRFBuffer()
 	{
+		MemoryScope scope(MemorySubsystem::delay_lines);
 		// check if vectors exist in the recycling bin
 		// if yes, then reuse vector
 		recycling_bin = RFBufferRecyclingBin<T>::get_instance();
@@ -94,15 +112,50 @@ public:
 		}
 	}
 
-	T operator[](int idx ){ return vect[idx]; }
+	T operator[](int idx ){ return vect[position(idx)]; }
+	void set(int idx, T val){ vect[position(idx)] = val; }
 
-	void push_back(T val){ vect.push_back(val); }
+	void push_back(T val)
+	{
+		if (max_size > 0 && (int) vect.size() >= max_size)
+		{
+			// full, overwrite the oldest sample
+			vect[head] = val;
+			head = head + 1 < (int) vect.size() ? head + 1 : 0;
+			return;
+		}
+		if (vect.size() < vect.capacity())
+		{
+			vect.push_back(val);
+			return;
+		}
+		// vector grows
+		MemoryScope scope(MemorySubsystem::delay_lines);
+		vect.push_back(val);
+	}
+
+	T back() { return (*this)[vect.size() - 1]; }
+
+	// Keeps at most the newest new_max_size samples from now on
+	void set_max_size(int new_max_size)
+	{
+		rotate(vect.begin(), vect.begin() + head, vect.end());
+		head = 0;
+		if ((int) vect.size() > new_max_size)
+			vect.erase(vect.begin(), vect.end() - new_max_size);
+		max_size = new_max_size;
+	}
+
+	// drops every sample, keeping the storage
+	void clear()
+	{
+		vect.clear();
+		head = 0;
+	}
 
-	T back() { return vect.back(); }
-    void resize(int new_size){ return vect.resize(new_size); }
 	int size() { return vect.size(); }
 	int capacity() { return vect.capacity(); }
 
-	~RecycledRFBuffer(){ recycling_bin->add_vector(vect); }
+	~RecycledRFBuffer(){ recycling_bin->add_vector(move(vect)); }
 
 };
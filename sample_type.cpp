@@ -0,0 +1,62 @@
+#include <cstdint>
+#include <cmath>
+
+//
+// Sample types used by the RF and DSP chain
+//
+// rf_sample_t is the type stored in RF delay lines and in the EM field.
+// dsp_sample_t is the type signal processors and filters compute in.
+// Orbit math and oscillator phase always stay in double.
+//
+// Selected at build time:
+//     (default)              double / double
+//     -DSAMPLE_TYPE_FLOAT    float  / float
+//     -DSAMPLE_TYPE_FIXED16  Fixed16 / float
+//
+
+// 16 bit fixed point sample. The value is raw / 32767 * scale, where
+// scale is kept by the container holding the samples (block floating
+// point). Containers grow their scale by powers of two when a larger
+// value is stored.
+struct Fixed16 {
+    int16_t raw = 0;
+};
+
+// Converts between double and a stored sample type. "scale" is only
+// used by fixed point types.
+template<typename T>
+struct SampleCodec {
+    static constexpr int is_fixed = 0;
+    static T encode(double value, double) { return (T) value; }
+    static double decode(T sample, double) { return sample; }
+};
+
+template<>
+struct SampleCodec<Fixed16> {
+    static constexpr int is_fixed = 1;
+    static Fixed16 encode(double value, double scale) {
+        Fixed16 sample;
+        if (scale == 0)
+            return sample;
+        double raw = round(value / scale * 32767);
+        sample.raw = (int16_t) (raw > 32767 ? 32767 : (raw < -32767 ? -32767 : raw));
+        return sample;
+    }
+    static double decode(Fixed16 sample, double scale) { return sample.raw * (scale / 32767); }
+};
+
+// smallest power of two scale that holds "value"
+double fixed_point_scale_for(double value) {
+    return exp2(ceil(log2(fabs(value))));
+}
+
+#if defined(SAMPLE_TYPE_FIXED16)
+using rf_sample_t = Fixed16;
+using dsp_sample_t = float;
+#elif defined(SAMPLE_TYPE_FLOAT)
+using rf_sample_t = float;
+using dsp_sample_t = float;
+#else
+using rf_sample_t = double;
+using dsp_sample_t = double;
+#endif
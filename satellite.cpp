@@ -1,4 +1,5 @@
 #include "orbit.cpp"
+#include "ephemeris.cpp"
 #include "rf.cpp"
 #include "transceiver.cpp"
 #include <cmath>
@@ -7,6 +8,14 @@
 
 using namespace std;
 
+// Orbit of one satellite that can be stepped ahead without moving the
+// satellite, see Satellite::advance_orbit_state
+struct OrbitState {
+    double pos[3];      // m
+    double vel[3];      // m/s
+    long ephemeris_step;
+};
+
 class Satellite {
     // global container for satellite positions
     SatellitePositions *sat_positions;
@@ -14,14 +23,29 @@ class Satellite {
     // and RF object
     unique_ptr<Transmitter> transmitter;
     unique_ptr<Receiver> receiver;
-    double last_tx_processed_sample;    // last value that was processed by tx signal processor
-    double last_received_rf_sample;     // last value that was recieved by antenna, befor being processed
+    // used instead of transmitter and receiver when satellite
+    // has more than one channel (FDMA)
+    unique_ptr<MultiChannelTransmitter> mc_transmitter;
+    unique_ptr<ChannelizedReceiver> mc_receiver;
+    vector<double> relay_channel_samples;   // last channel samples received by relay
+    double last_tx_processed_sample = 0;    // last value that was processed by tx signal processor
+    double last_received_rf_sample = 0;     // last value that was recieved by antenna, befor being processed
     // velocity in m/s
     double vel_x;   
     double vel_y;
     double vel_z;
     double dt;      // time delta per time step in seconds
     int sat_id;
+    // relay transmits silence while received RF is at or below this
+    // level. Negative disables the squelch.
+    double relay_squelch = -1;
+    // when set, positions are evaluated from the ephemeris instead
+    // of integrating the orbit
+    Ephemeris *ephemeris = NULL;
+    long ephemeris_step = 0;
+    // when set, position and velocity are set from outside (e.g. by a
+    // ConstellationPropagator) and move_one_frame does nothing
+    int external_orbit = 0;
 
     // Selects a random position around the earth at the givern altitude, r.
     // Also selects a random velocity vector with magnitude required for
@@ -44,10 +68,32 @@ class Satellite {
         this->vel_z = get<2>(vel);
     }
 
+    // sets position from the ephemeris at the current time step
+    void set_ephemeris_position() {
+        double x, y, z;
+        tie(x, y, z) = this->ephemeris->get_position(this->sat_id, this->ephemeris_step * this->dt);
+        this->sat_positions->set_position(this->sat_id, x, y, z);
+    }
+
+    // one time step of the orbit integrator
+    static void integrate_frame(double *pos, double *vel, double dt) {
+        tuple<double, double, double> gravity = calc_gravity(make_tuple(pos[0], pos[1], pos[2]));
+        vel[0] += vel[0] + (get<0>(gravity) * dt);
+        vel[1] += vel[1] + (get<1>(gravity) * dt);
+        vel[2] += vel[2] + (get<2>(gravity) * dt);
+
+        pos[0] += vel[0] * dt;
+        pos[1] += vel[0] * dt;
+        pos[2] += vel[0] * dt;
+    }
+
 public:
 
-    Satellite(int sat_id_in, unique_ptr<AbstractSigProcFactory> &sig_proc_factory, SatellitePositions * sat_pos_in, EMField * em_field_in, double dt_in, double frequency, double r)
+    // With num_channels > 1 the satellite gets a multi channel transmitter
+    // and receiver. Channel i uses carrier frequency + i * channel_spacing.
+    Satellite(int sat_id_in, unique_ptr<AbstractSigProcFactory> &sig_proc_factory, SatellitePositions * sat_pos_in, EMField * em_field_in, double dt_in, double frequency, double r, int num_channels = 1, double channel_spacing = 0)
     {
+        MemoryScope scope(MemorySubsystem::satellites);
         this->sat_id = sat_id_in;
         this->sat_positions = sat_pos_in;
         this->dt = dt_in;
@@ -55,33 +101,142 @@ public:
         // randomly select position and velocity vectors
         set_random_pos_and_vel(r);
 
+        if (num_channels > 1)
+        {
+            this->mc_transmitter = make_unique<MultiChannelTransmitter>(em_field_in, sat_id_in, sig_proc_factory, sat_pos_in, frequency, channel_spacing, num_channels, dt_in);
+            this->mc_receiver = make_unique<ChannelizedReceiver>(em_field_in, sat_id_in, sig_proc_factory, frequency, channel_spacing, num_channels, dt_in);
+            this->relay_channel_samples.assign(num_channels, 0);
+            return;
+        }
+
         this->transmitter = make_unique<Transmitter>(em_field_in, sat_id_in, sig_proc_factory, sat_pos_in, frequency, dt_in);
         this->receiver = make_unique<Receiver>(em_field_in, sat_id_in, sig_proc_factory, sat_pos_in, frequency, dt_in);
     }
 
-    // TODO: implementation of exceptions
-    // util::Expected<void> move_one_frame() {
+    // orbit divergence is caught by HealthMonitor (health.cpp)
     void move_one_frame() {
-        tuple<double, double, double> gravity = calc_gravity(sat_positions->get_position(this->sat_id));
-        this->vel_x += this->vel_x + (get<0>(gravity) * this->dt);
-        this->vel_y += this->vel_y + (get<1>(gravity) * this->dt);
-        this->vel_z += this->vel_z + (get<2>(gravity) * this->dt);
+        if (this->external_orbit)
+            return;
+        if (this->ephemeris != NULL)
+        {
+            this->ephemeris_step++;
+            set_ephemeris_position();
+            return;
+        }
 
-        // check orbit status and throw exception if invalid
-        // tuple<double, double, double> x_y_z sat_positions->get_position(this->sat_id);
-        // if sqrt(20000000 < get<0>(gravity)*get<0>(gravity) + get<1>(gravity)*get<1>(gravity) + get<2>(gravity)*get<2>(gravity))
-        //     return std::range_error("Orbit Divergence Error");
-        
-        sat_positions->update_position(this->sat_id, this->vel_x * this->dt, this->vel_x * this->dt, this->vel_x * this->dt);
+        OrbitState state = get_orbit_state();
+        integrate_frame(state.pos, state.vel, this->dt);
+        sat_positions->set_position(this->sat_id, state.pos[0], state.pos[1], state.pos[2]);
+        this->vel_x = state.vel[0];
+        this->vel_y = state.vel[1];
+        this->vel_z = state.vel[2];
     }
 
     void retransmit() {
+        if (this->mc_receiver != NULL)
+        {
+            // channel samples arrive at the decimated rate, so the last
+            // received block is held until the next one is ready
+            this->mc_receiver->receive_signals(this->relay_channel_samples);
+            this->last_received_rf_sample = this->mc_receiver->get_last_received_rf_sample();
+            this->mc_transmitter->transmit_signals(this->relay_channel_samples, 0);
+            this->last_tx_processed_sample = this->mc_transmitter->get_last_processed_sample();
+            return;
+        }
+
         double signal = this->receiver->receive_signal(0);
         this->last_received_rf_sample = this->receiver->get_last_received_rf_sample();
+        if (fabs(this->last_received_rf_sample) <= this->relay_squelch)
+        {
+            transmit_silence();
+            return;
+        }
         this->transmitter->transmit_signal(signal, 0);
         this->last_tx_processed_sample = this->transmitter->get_last_processed_sample();
     }
 
+    void set_relay_squelch(double relay_squelch_in) { this->relay_squelch = relay_squelch_in; }
+
+    // Transmitter is keyed off for this time step. The modulator still
+    // runs so its oscillator stays in phase.
+    void transmit_silence()
+    {
+        this->transmitter->modulate(0);
+        this->transmitter->propagate(0);
+        this->last_tx_processed_sample = 0;
+    }
+
+    // 1 if nothing this satellite transmitted can still reach a receiver
+    int is_drained() { return this->transmitter->is_drained(); }
+
+    // links from this satellite that still carry its signal
+    int count_active_links() {
+        if (this->mc_transmitter != NULL)
+            return this->mc_transmitter->count_active_links();
+        return this->transmitter->count_active_links();
+    }
+
+    // phase noise on every link from this satellite, and noise at
+    // its receiver
+    void set_channel(ChannelImpairments *channel) {
+        if (this->mc_transmitter != NULL)
+        {
+            this->mc_transmitter->set_channel(channel);
+            this->mc_receiver->set_channel(channel);
+            return;
+        }
+        this->transmitter->set_channel(channel);
+        this->receiver->set_channel(channel);
+    }
+
+    // antenna gains of every link from this satellite
+    void set_link_gains(const LinkGains *link_gains) {
+        if (this->mc_transmitter != NULL)
+            this->mc_transmitter->set_link_gains(link_gains);
+        else
+            this->transmitter->set_link_gains(link_gains);
+    }
+
+    // Signals recorded by a CaptureSet, any tap may be NULL (single
+    // channel satellites only)
+    void set_capture_taps(CaptureTap *tx_audio, CaptureTap *tx_rf, CaptureTap *rx_rf, CaptureTap *rx_audio) {
+        if (this->transmitter == NULL)
+            return;
+        this->transmitter->set_capture_taps(tx_audio, tx_rf);
+        this->receiver->set_capture_taps(rx_rf, rx_audio);
+    }
+
+    // bytes allocated for the transmit delay line
+    size_t get_buffer_bytes() {
+        if (this->mc_transmitter != NULL)
+            return this->mc_transmitter->get_buffer_bytes();
+        return this->transmitter->get_buffer_bytes();
+    }
+
+    // Skips n silent time steps: orbit is advanced analytically in one
+    // step, and signal processors and delay lines skip ahead.
+    void skip_time(long n)
+    {
+        this->transmitter->skip_time(n);
+        this->receiver->skip_time(n);
+
+        if (this->ephemeris != NULL)
+        {
+            this->ephemeris_step += n;
+            set_ephemeris_position();
+            return;
+        }
+
+        double pos[3];
+        double vel[3] = {this->vel_x, this->vel_y, this->vel_z};
+        tie(pos[0], pos[1], pos[2]) = sat_positions->get_position(this->sat_id);
+        kepler_advance(pos, vel, n * this->dt);
+        sat_positions->set_position(this->sat_id, pos[0], pos[1], pos[2]);
+        this->vel_x = vel[0];
+        this->vel_y = vel[1];
+        this->vel_z = vel[2];
+    }
+
     // Transmit value in "signal". To print debug info use
     // next method with "debug" argument.
     void transmit_signal(double signal)
@@ -111,21 +266,163 @@ public:
         return signal;
     }
 
-    tuple<double, double, double> get_satellite_position() {
+    // Transmit one sample per channel (multi channel satellites only)
+    void transmit_signals(const vector<double> &signals, int debug)
+    {
+        this->mc_transmitter->transmit_signals(signals, debug);
+        this->last_tx_processed_sample = this->mc_transmitter->get_last_processed_sample();
+    }
+
+    // Returns 1 when new channel samples were written to "signals"
+    // (multi channel satellites only)
+    int receive_signals(vector<double> &signals)
+    {
+        int ready = this->mc_receiver->receive_signals(signals);
+        this->last_received_rf_sample = this->mc_receiver->get_last_received_rf_sample();
+        return ready;
+    }
 
-        tuple<double, double, double> pos_tuple = sat_positions->get_position(this->sat_id);
+    // Split transmit / receive used by staged engines, where
+    // modulation, propagation and demodulation run separately.
+    double modulate(double signal)
+    {
+        this->last_tx_processed_sample = this->transmitter->modulate(signal);
+        return this->last_tx_processed_sample;
+    }
+
+    void propagate(double rf_sample) { this->transmitter->propagate(rf_sample); }
+
+    double receive_rf()
+    {
+        this->last_received_rf_sample = this->receiver->receive_rf();
+        return this->last_received_rf_sample;
+    }
+
+    // visits the rx signal processor (single channel only)
+    void accept_rx_visitor(RxProcessingVisitor const &v) { this->receiver->accept(v); }
+
+    double demodulate(double rf_sample) { return this->receiver->demodulate(rf_sample); }
+
+    // Block versions of the above. Block engines compute the field at
+    // a satellite by summing add_field_block_at_satellite over all
+    // transmitting satellites.
+    void propagate_block(const double *rf_samples, int n) { this->transmitter->propagate_block(rf_samples, n); }
 
-        double x_ret = get<0>(pos_tuple);
-        double y_ret = get<1>(pos_tuple);
-        double z_ret = get<2>(pos_tuple);
+    void add_field_block_at_satellite(int rx_sat_id, double *out, int n, int pushed) {
+        this->transmitter->add_field_block_at_satellite(rx_sat_id, out, n, pushed);
+    }
+
+    // Adds this satellite's receiver noise to the next n time steps of
+    // the field a block engine summed for it. Call once per block for
+    // every satellite that receives.
+    void add_receiver_noise_block(double *rf, int n) { this->receiver->add_noise_block(rf, n); }
+
+    // field this satellite's signal causes at point (x, y, z)
+    // (single channel only)
+    double calc_field_at_point(double x, double y, double z) { return this->transmitter->calc_field_at_point(x, y, z); }
 
-        double r = sqrt(x_ret * x_ret + y_ret * y_ret + z_ret * z_ret);
-        double rho = atan(y_ret / x_ret);
-        double theta = acos(z_ret / r);
+    // number of time steps for this satellite's signal to reach rx_sat_id
+    int link_latency(int rx_sat_id) { return this->transmitter->link_latency(rx_sat_id); }
 
-        return tuple<double, double, double> {r, rho, theta};
+    // Relays a block of received RF. Either demodulates and remodulates
+    // every sample, or forwards the RF transparently with "relay_gain".
+    void retransmit_block(const double *rf_in, double *rf_out, int n, int transparent, double relay_gain)
+    {
+        for (int k = 0; k < n; ++k)
+        {
+            if (transparent)
+                rf_out[k] = relay_gain * rf_in[k];
+            else
+                rf_out[k] = this->transmitter->modulate(this->receiver->demodulate(rf_in[k]));
+        }
+        if (n > 0)
+        {
+            this->last_received_rf_sample = rf_in[n - 1];
+            this->last_tx_processed_sample = rf_out[n - 1];
+        }
     }
 
+    // Orbit is integrated in "orbit_positions" from now on, while RF
+    // keeps using the positions container given to the constructor.
+    // Lets an orbit stage run ahead of the RF stage.
+    void set_orbit_positions(SatellitePositions *orbit_positions) {
+        this->sat_positions = orbit_positions;
+    }
+
+    // Positions come from "ephemeris_in" from now on, starting again
+    // at time 0
+    void set_ephemeris(Ephemeris *ephemeris_in) {
+        this->ephemeris = ephemeris_in;
+        this->ephemeris_step = 0;
+        set_ephemeris_position();
+    }
+
+    // Predicted (x, y, z) position "t" seconds from now, from the
+    // ephemeris or by two body propagation of the current state.
+    // Doesn't move the satellite.
+    tuple<double, double, double> predict_position(double t) {
+        if (this->ephemeris != NULL)
+            return this->ephemeris->get_position(this->sat_id, this->ephemeris_step * this->dt + t);
+
+        double pos[3];
+        double vel[3] = {this->vel_x, this->vel_y, this->vel_z};
+        tie(pos[0], pos[1], pos[2]) = sat_positions->get_position(this->sat_id);
+        kepler_advance(pos, vel, t);
+        return make_tuple(pos[0], pos[1], pos[2]);
+    }
+
+    // current orbit, see advance_orbit_state
+    OrbitState get_orbit_state() {
+        OrbitState state;
+        tie(state.pos[0], state.pos[1], state.pos[2]) = sat_positions->get_position(this->sat_id);
+        state.vel[0] = this->vel_x;
+        state.vel[1] = this->vel_y;
+        state.vel[2] = this->vel_z;
+        state.ephemeris_step = this->ephemeris_step;
+        return state;
+    }
+
+    // Advances "state" by n time steps the way n calls of
+    // move_one_frame would, without moving the satellite. With an
+    // ephemeris this is one lookup, otherwise the orbit is integrated
+    // step by step, so predictions match the run exactly. Orbits set
+    // from outside (set_external_orbit) can't be predicted here.
+    void advance_orbit_state(OrbitState &state, long n) {
+        if (this->ephemeris != NULL)
+        {
+            state.ephemeris_step += n;
+            tie(state.pos[0], state.pos[1], state.pos[2]) = this->ephemeris->get_position(this->sat_id, state.ephemeris_step * this->dt);
+            return;
+        }
+        for (long k = 0; k < n; ++k)
+            integrate_frame(state.pos, state.vel, this->dt);
+    }
+
+    tuple<double, double, double> get_satellite_position() {
+        return cartesian_to_spherical(sat_positions->get_position(this->sat_id));
+    }
+
+    // (x, y, z) position in meters
+    tuple<double, double, double> get_cartesian_position() {
+        return sat_positions->get_position(this->sat_id);
+    }
+
+    // (x, y, z) velocity in m/s
+    tuple<double, double, double> get_velocity() {
+        return make_tuple(this->vel_x, this->vel_y, this->vel_z);
+    }
+
+    void set_velocity(double vel_x_in, double vel_y_in, double vel_z_in) {
+        this->vel_x = vel_x_in;
+        this->vel_y = vel_y_in;
+        this->vel_z = vel_z_in;
+    }
+
+    void set_external_orbit(int external_orbit_in) { this->external_orbit = external_orbit_in; }
+
+    // 1 if positions come from an ephemeris, velocity isn't updated then
+    int has_ephemeris() { return this->ephemeris != NULL; }
+
     double get_last_processed_tx_sample() { return this->last_tx_processed_sample; }
     double get_last_received_rf_sample() { return this->last_received_rf_sample; }
 };
\ No newline at end of file
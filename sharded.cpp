@@ -0,0 +1,376 @@
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+//
+// Multi process sharded constellation
+//
+// Satellites are split into contiguous shards and every shard runs in
+// its own process (fork). A shard only owns the delay lines and signal
+// processors of its satellites. Every block, each shard computes the
+// field its transmitters cause at every receiver, keeps the part for
+// its own receivers and sends the part for each other shard through a
+// shared memory ring buffer. Orbits are cheap next to the links, so
+// every shard integrates all orbits itself (same seed, same results)
+// instead of exchanging positions.
+//
+// Blocks are never longer than the shortest link latency, so a block
+// only depends on samples of earlier blocks and all shards process a
+// block at the same time. The shard with the rx satellite runs in the
+// calling process and prints the received samples.
+//
+// A shard that fails raises an abort flag in the shared memory, and
+// everyone spinning on a ring gives up when it sees it. The calling
+// process polls the shard processes while its own shard runs and raises
+// the flag when one of them dies, and shard processes are killed when
+// the calling process dies.
+//
+// Satellite 0 transmits, the last one receives and the rest relay, as
+// in main. Requires Satellite (satellite.cpp), AudioSource
+// (data_source.cpp) and WavFileSink (audio_file.cpp).
+//
+
+// Single producer / single consumer ring in memory shared between
+// processes. Same interface as SpscQueue, slots are raw bytes, except
+// that waiting for a slot gives up and returns NULL once the shared
+// abort flag is set.
+class ShmRing {
+
+    struct Header {
+        alignas(64) atomic<uint64_t> head;  // next slot to be read
+        alignas(64) atomic<uint64_t> tail;  // next slot to be written
+    };
+
+    Header *header;
+    const atomic<int> *abort_flag;
+    char *slots;
+    size_t slot_size;
+    uint64_t capacity;
+
+public:
+    static size_t bytes_needed(size_t slot_size_in, uint64_t capacity_in) {
+        return sizeof(Header) + slot_size_in * capacity_in;
+    }
+
+    // "memory" (bytes_needed bytes) and "abort_flag_in" must be shared
+    // and zeroed, and outlive the ring
+    ShmRing(void *memory, const atomic<int> *abort_flag_in, size_t slot_size_in, uint64_t capacity_in) {
+        this->header = new (memory) Header();
+        this->abort_flag = abort_flag_in;
+        this->slots = (char *) memory + sizeof(Header);
+        this->slot_size = slot_size_in;
+        this->capacity = capacity_in;
+    }
+
+    void *producer_slot() {
+        uint64_t t = this->header->tail.load(memory_order_relaxed);
+        while (t - this->header->head.load(memory_order_acquire) >= this->capacity)
+        {
+            if (this->abort_flag->load(memory_order_acquire))
+                return NULL;
+            this_thread::yield();
+        }
+        return this->slots + (t % this->capacity) * this->slot_size;
+    }
+
+    void push() { this->header->tail.store(this->header->tail.load(memory_order_relaxed) + 1, memory_order_release); }
+
+    const void *consumer_slot() {
+        uint64_t h = this->header->head.load(memory_order_relaxed);
+        while (this->header->tail.load(memory_order_acquire) == h)
+        {
+            if (this->abort_flag->load(memory_order_acquire))
+                return NULL;
+            this_thread::yield();
+        }
+        return this->slots + (h % this->capacity) * this->slot_size;
+    }
+
+    void pop() { this->header->head.store(this->header->head.load(memory_order_relaxed) + 1, memory_order_release); }
+};
+
+class ShardedEngine {
+
+    // message from one shard to another for one block. Followed by
+    // the field for every satellite of the receiving shard, block_size
+    // doubles per satellite.
+    struct BlockMessage {
+        int64_t step;
+        int32_t n;
+    };
+
+    vector<Satellite> &satellites;
+    AudioSource &audio_source;
+    WavFileSink *audio_sink = NULL;     // optional, gets received audio
+    int num_sats;
+    int num_shards;
+    int block_size;
+    int transparent;        // forward RF instead of demodulating / remodulating
+    double relay_gain;      // gain used for transparent forwarding
+    int ring_capacity = 4;
+
+    vector<int> shard_start;            // first satellite of each shard
+    void *shared_memory = MAP_FAILED;
+    size_t shared_bytes = 0;
+    atomic<int> *abort_flag = NULL;     // in shared_memory, set when a shard fails
+    vector<ShmRing> rings;              // ring from shard i to shard j at i * num_shards + j
+
+    int shard_size(int shard) { return this->shard_start[shard + 1] - this->shard_start[shard]; }
+
+    size_t slot_size(int to_shard) { return sizeof(BlockMessage) + shard_size(to_shard) * this->block_size * sizeof(double); }
+
+    // Shortest latency of any link that carries signal. Blocks no
+    // longer than this have no dependencies inside a block.
+    int min_link_latency() {
+        int rx_sat = this->num_sats - 1;
+        int min_latency = INT_MAX;
+        for (int t = 0; t < rx_sat; ++t)
+            for (int r = 1; r < this->num_sats; ++r)
+                if (r != t)
+                {
+                    int latency = this->satellites[t].link_latency(r);
+                    if (latency < min_latency)
+                        min_latency = latency;
+                }
+        return min_latency;
+    }
+
+    // Returns 0 if the shard gave up, because it failed or another
+    // shard did
+    int run_shard(int shard, long num_time_steps, ostream *ins) {
+        int tx_sat = 0;
+        int rx_sat = this->num_sats - 1;
+        int first = this->shard_start[shard];
+        int last = this->shard_start[shard + 1];
+        // field at every satellite from this shard's transmitters
+        vector<vector<double>> field(this->num_sats, vector<double>(this->block_size));
+        vector<double> tx_block(this->block_size);
+        vector<double> audio(this->block_size);
+
+        for (long step = 0; step < num_time_steps; )
+        {
+            long remaining = num_time_steps - step;
+            int n = remaining < this->block_size ? remaining : this->block_size;
+            int min_latency = min_link_latency();
+            if (min_latency < n)
+                n = min_latency > 1 ? min_latency : 1;
+
+            // contributions of this shard's transmitters, from samples
+            // of earlier blocks only
+            for (int r = 0; r < this->num_sats; ++r)
+                fill(field[r].begin(), field[r].begin() + n, 0);
+            for (int t = first; t < last; ++t)
+                if (t != rx_sat)
+                    for (int r = 1; r < this->num_sats; ++r)
+                        if (r != t)
+                            this->satellites[t].add_field_block_at_satellite(r, field[r].data(), n, 0);
+
+            // send the part for every other shard
+            for (int j = 0; j < this->num_shards; ++j)
+            {
+                if (j == shard)
+                    continue;
+                ShmRing &ring = this->rings[shard * this->num_shards + j];
+                BlockMessage *message = (BlockMessage *) ring.producer_slot();
+                if (message == NULL)
+                    return 0;
+                message->step = step;
+                message->n = n;
+                double *rows = (double *) (message + 1);
+                for (int r = this->shard_start[j]; r < this->shard_start[j + 1]; ++r)
+                    memcpy(rows + (r - this->shard_start[j]) * this->block_size, field[r].data(), n * sizeof(double));
+                ring.push();
+            }
+
+            // add the parts other shards sent for this shard
+            for (int j = 0; j < this->num_shards; ++j)
+            {
+                if (j == shard)
+                    continue;
+                ShmRing &ring = this->rings[j * this->num_shards + shard];
+                const BlockMessage *message = (const BlockMessage *) ring.consumer_slot();
+                if (message == NULL)
+                    return 0;
+                if (message->step != step || message->n != n)
+                {
+                    cerr << "Shard " << shard << ": block mismatch with shard " << j << " at Time Step: " << step << endl;
+                    this->abort_flag->store(1, memory_order_release);
+                    return 0;
+                }
+                const double *rows = (const double *) (message + 1);
+                for (int r = first; r < last; ++r)
+                    for (int k = 0; k < n; ++k)
+                        field[r][k] += rows[(r - first) * this->block_size + k];
+                ring.pop();
+            }
+
+            // process this shard's satellites
+            for (int s = first; s < last; ++s)
+            {
+                if (s != tx_sat)
+                    this->satellites[s].add_receiver_noise_block(field[s].data(), n);
+                if (s == tx_sat)
+                {
+                    for (int k = 0; k < n; ++k)
+                        tx_block[k] = this->satellites[s].modulate(this->audio_source.get_next());
+                    this->satellites[s].propagate_block(tx_block.data(), n);
+                }
+                else if (s == rx_sat)
+                {
+                    for (int k = 0; k < n; ++k)
+                    {
+                        audio[k] = this->satellites[s].demodulate(field[s][k]);
+                        if (this->audio_sink != NULL)
+                            this->audio_sink->write(audio[k]);
+                    }
+                }
+                else
+                {
+                    this->satellites[s].retransmit_block(field[s].data(), tx_block.data(), n, this->transparent, this->relay_gain);
+                    this->satellites[s].propagate_block(tx_block.data(), n);
+                }
+            }
+
+            // move satellites through the block
+            for (int k = 0; k < n; ++k)
+                for (int s = 0; s < this->num_sats; ++s)
+                    this->satellites[s].move_one_frame();
+
+            for (int k = 0; ins != NULL && k < n; ++k)
+            {
+                *ins << "Time Step: " << step + k << indent << endl;
+                *ins << "Received RF Sample: " << field[rx_sat][k] << endl;
+                *ins << "Received Audio Sample: " << audio[k] << unindent << endl;
+            }
+            step += n;
+        }
+        return 1;
+    }
+
+    // Polls the shard processes until all of them have exited. One that
+    // fails raises the abort flag, so no shard waits for it forever.
+    void watch_shards(const vector<pid_t> &children, int &all_ok) {
+        vector<pid_t> running = children;
+        while (!running.empty())
+        {
+            for (size_t c = 0; c < running.size(); )
+            {
+                int status;
+                pid_t result = waitpid(running[c], &status, WNOHANG);
+                if (result == 0)
+                {
+                    ++c;
+                    continue;
+                }
+                if (result < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                {
+                    all_ok = 0;
+                    this->abort_flag->store(1, memory_order_release);
+                }
+                running.erase(running.begin() + c);
+            }
+            if (!running.empty())
+                this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+public:
+    // num_shards_in must be at least 1, see is_valid
+    ShardedEngine(vector<Satellite> &satellites_in, AudioSource &audio_source_in, int num_shards_in, int block_size_in, int transparent_in = 0, double relay_gain_in = 1)
+        : satellites(satellites_in), audio_source(audio_source_in)
+    {
+        this->num_sats = satellites_in.size();
+        this->num_shards = num_shards_in < this->num_sats ? num_shards_in : this->num_sats;
+        this->block_size = block_size_in;
+        this->transparent = transparent_in;
+        this->relay_gain = relay_gain_in;
+        if (this->num_shards <= 0)
+            return;
+        for (int i = 0; i <= this->num_shards; ++i)
+            this->shard_start.push_back((long) i * this->num_sats / this->num_shards);
+
+        // one anonymous shared mapping for the abort flag and all rings,
+        // inherited by the shard processes
+        this->shared_bytes = 64;
+        vector<size_t> offsets;
+        for (int i = 0; i < this->num_shards; ++i)
+            for (int j = 0; j < this->num_shards; ++j)
+            {
+                // rings from a shard to itself are never used
+                offsets.push_back(this->shared_bytes);
+                size_t ring_bytes = i != j ? ShmRing::bytes_needed(slot_size(j), this->ring_capacity) : ShmRing::bytes_needed(0, 0);
+                this->shared_bytes += (ring_bytes + 63) / 64 * 64;
+            }
+        this->shared_memory = mmap(NULL, this->shared_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (this->shared_memory == MAP_FAILED)
+            return;
+        this->abort_flag = new (this->shared_memory) atomic<int>(0);
+        for (int i = 0; i < this->num_shards; ++i)
+            for (int j = 0; j < this->num_shards; ++j)
+                this->rings.emplace_back((char *) this->shared_memory + offsets[i * this->num_shards + j], this->abort_flag, slot_size(j), this->ring_capacity);
+    }
+
+    // 1 if there is at least one shard and the shared memory for the
+    // rings could be mapped
+    int is_valid() { return this->shared_memory != MAP_FAILED; }
+
+    int get_num_shards() { return this->num_shards; }
+
+    // only written by the shard with the rx satellite, which runs in
+    // the calling process
+    void set_audio_sink(WavFileSink *audio_sink_in) { this->audio_sink = audio_sink_in; }
+
+    // Returns 1 if every shard process finished normally
+    int run(long num_time_steps, ostream &ins) {
+        int own_shard = this->num_shards - 1;
+        pid_t parent = getpid();
+        vector<pid_t> children;
+        for (int shard = 0; shard < own_shard; ++shard)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                // killed with the calling process, which may have died
+                // before prctl
+                prctl(PR_SET_PDEATHSIG, SIGKILL);
+                if (getppid() != parent)
+                    _exit(1);
+                // output and files belong to the calling process, so
+                // the shard exits without running destructors
+                this->audio_sink = NULL;
+                _exit(run_shard(shard, num_time_steps, NULL) ? 0 : 1);
+            }
+            if (pid < 0)
+            {
+                ins << "Could not start shard process " << shard << endl;
+                for (pid_t child : children)
+                    kill(child, SIGKILL);
+                return 0;
+            }
+            children.push_back(pid);
+        }
+
+        int all_ok = 1;
+        thread watcher(&ShardedEngine::watch_shards, this, cref(children), ref(all_ok));
+        int own_ok = run_shard(own_shard, num_time_steps, &ins);
+        watcher.join();
+        return all_ok && own_ok;
+    }
+
+    ~ShardedEngine() {
+        if (this->shared_memory != MAP_FAILED)
+            munmap(this->shared_memory, this->shared_bytes);
+    }
+};
@@ -1,7 +1,9 @@
 #include <string_view>
 #include <iostream>
+#include <complex>
 #include "signal_processing_factory.cpp"
 #include "LowPassFilter.cpp"
+#include "psk.cpp"
 
 
 class SignalProcessing
@@ -20,14 +22,19 @@ public:
     double get_frequency() { return this->carrier_frequency; }
     double get_time() { return this->time_since_start; }
     void increment_time() { this->time_since_start += dt; }
+    // skip n time steps without processing
+    void advance_time(long n) { this->time_since_start += n * dt; }
 };
 
 class TxProcessing;
 class TxAMProcessing;
 class TxFMProcessing;
+class TxPSKProcessing;
 class RxProcessing;
 class RxAMProcessing;
 class RxFMProcessing;
+class RxPSKProcessing;
+class RxChannelProcessing;
 
 //
 // visitors
@@ -37,12 +44,14 @@ struct TxProcessingVisitor {
     virtual void visit(TxProcessing &) const = 0;
     virtual void visit(TxAMProcessing &) const = 0;
     virtual void visit(TxFMProcessing &) const = 0;
+    virtual void visit(TxPSKProcessing &) const = 0;
 };
 
 struct RxProcessingVisitor {
     virtual void visit(RxProcessing &) const = 0;
     virtual void visit(RxAMProcessing &) const = 0;
     virtual void visit(RxFMProcessing &) const = 0;
+    virtual void visit(RxPSKProcessing &) const = 0;
 };
 
 //
@@ -69,6 +78,18 @@ public:
     virtual void accept(RxProcessingVisitor const &v) { v.visit(*this); }
 };
 
+// Demodulates one channel of a channelizer. Input is the
+// complex baseband sample of the channel, at the channel rate.
+class RxChannelProcessing {
+protected:
+    double dt = 0;  // seconds between channel samples
+public:
+    virtual double process_channel_sample(complex<double>) = 0;
+    // first parameter is the carrier frequency of the channel
+    virtual void set_parameters(double, double dt_in) { this->dt = dt_in; }
+    virtual ~RxChannelProcessing() = default;
+};
+
 //
 // AM Signal Processing Classes
 //
@@ -90,7 +111,7 @@ public:
     }
 
     double process_tx_signal(double signal) override {
-        double tx_signal = ((signal / this->A) * this->m + 1) * sin(2 * M_PI * get_frequency() * get_time());
+        dsp_sample_t tx_signal = ((signal / this->A) * this->m + 1) * sin(2 * M_PI * get_frequency() * get_time());
         increment_time();
         return tx_signal;
     }
@@ -118,13 +139,13 @@ public:
 
     double process_rx_signal(double signal) override {
         // frequency shift
-        double amplitude = sin(2 * M_PI * get_frequency() * get_time());
-        double shifted_signal = signal * amplitude;
+        dsp_sample_t amplitude = sin(2 * M_PI * get_frequency() * get_time());
+        dsp_sample_t shifted_signal = signal * amplitude;
 
         increment_time();
 
         // low pass filter
-        double filtered_signal = lpf.update(100 * shifted_signal);
+        dsp_sample_t filtered_signal = lpf.update(100 * shifted_signal);
 
         return filtered_signal;
     }
@@ -132,6 +153,15 @@ public:
     virtual void accept(RxProcessingVisitor const &v) override { v.visit(*this); }
 };
   
+class RxChannelAMProcessing : public RxChannelProcessing {
+public:
+    double process_channel_sample(complex<double> signal) override {
+        // envelope detection. A real carrier of amplitude a
+        // has baseband magnitude a / 2.
+        return 2 * abs(signal);
+    }
+};
+
 //
 // FM Signal Processing Classes
 //
@@ -151,7 +181,7 @@ public:
 
     double process_tx_signal(double signal) override {
         // frequency shift
-        double fm_signal = sin(2*M_PI*(get_frequency() + signal * this->dev) * get_time());
+        dsp_sample_t fm_signal = sin(2*M_PI*(get_frequency() + signal * this->dev) * get_time());
 
         increment_time();
 
@@ -186,15 +216,15 @@ public:
         // to get the final signal.
 
         // frequency shift
-        double am_shift_left = sin(2*M_PI*(get_frequency() + this->dev/2) * get_time());
-        double am_shift_right = sin(2*M_PI*(get_frequency() - this->dev/2) * get_time());
+        dsp_sample_t am_shift_left = sin(2*M_PI*(get_frequency() + this->dev/2) * get_time());
+        dsp_sample_t am_shift_right = sin(2*M_PI*(get_frequency() - this->dev/2) * get_time());
         increment_time();
 
         // low pass filter
-        double am_demod_left = lpf_left.update(100 * am_shift_left);
-        double am_demod_right = lpf_right.update(100 * am_shift_right);
+        dsp_sample_t am_demod_left = lpf_left.update(100 * am_shift_left);
+        dsp_sample_t am_demod_right = lpf_right.update(100 * am_shift_right);
 
-        double final_signal = am_demod_right - am_demod_left;
+        dsp_sample_t final_signal = am_demod_right - am_demod_left;
 
         return final_signal;
     }
@@ -203,3 +233,162 @@ public:
 
     virtual void accept(RxProcessingVisitor const &v) override { v.visit(*this); }
 };
+
+class RxChannelFMProcessing : public RxChannelProcessing {
+    complex<double> last_sample = 0;
+    double dev;   // frequency deviation
+
+public:
+    void set_parameters(double frequency_in, double dt_in) override {
+        this->dt = dt_in;
+        this->dev = 0.01 * frequency_in;   // same deviation as TxFMProcessing
+    }
+
+    double process_channel_sample(complex<double> signal) override {
+        // phase difference discriminator. The phase change between
+        // two channel samples is proportional to the frequency offset.
+        double phase_step = arg(signal * conj(this->last_sample));
+        this->last_sample = signal;
+        return phase_step / (2 * M_PI * this->dt * this->dev);
+    }
+};
+
+//
+// PSK Signal Processing Classes
+//
+// Digital modes. Transmitters ignore their input and send a PRBS test
+// pattern at psk_symbol_rate(frequency) symbols per second with
+// rectangular pulses, receivers count bit errors of the pattern (see
+// psk.cpp). A carrier of amplitude 1 carries symbol p as
+// Im(p * exp(j * 2 * pi * f * t)).
+//
+
+class TxPSKProcessing : public TxProcessing {
+    int bits_per_symbol;
+    int samples_per_symbol;
+    int sample_in_symbol = 0;
+    unsigned prbs_state = 0x7fff;
+    complex<double> symbol;
+
+public:
+    explicit TxPSKProcessing(int bits_per_symbol_in) : TxProcessing(-1, -1) {
+        this->bits_per_symbol = bits_per_symbol_in;
+    }
+
+    void set_parameters(double frequency_in, double dt_in) override {
+        set_frequency(frequency_in);
+        set_dt(dt_in);
+        this->samples_per_symbol = max(1, (int) round(1 / (psk_symbol_rate(frequency_in) * dt_in)));
+    }
+
+    double process_tx_signal(double) override {
+        if (this->sample_in_symbol == 0)
+        {
+            int b0 = prbs15_next(this->prbs_state);
+            int b1 = this->bits_per_symbol == 2 ? prbs15_next(this->prbs_state) : 0;
+            this->symbol = psk_map(this->bits_per_symbol, b0, b1);
+        }
+        if (++this->sample_in_symbol == this->samples_per_symbol)
+            this->sample_in_symbol = 0;
+
+        double carrier_phase = 2 * M_PI * get_frequency() * get_time();
+        dsp_sample_t psk_signal = this->symbol.real() * sin(carrier_phase) + this->symbol.imag() * cos(carrier_phase);
+        increment_time();
+        return psk_signal;
+    }
+
+    int get_bits_per_symbol() { return this->bits_per_symbol; }
+    int get_samples_per_symbol() { return this->samples_per_symbol; }
+
+    virtual void accept(TxProcessingVisitor const &v) override { v.visit(*this); }
+};
+
+class TxBPSKProcessing : public TxPSKProcessing {
+public:
+    explicit TxBPSKProcessing() : TxPSKProcessing(1) { }
+};
+
+class TxQPSKProcessing : public TxPSKProcessing {
+public:
+    explicit TxQPSKProcessing() : TxPSKProcessing(2) { }
+};
+
+class RxPSKProcessing : public RxProcessing {
+    int bits_per_symbol;
+    PskDetector detector;
+    BitErrorCounter bit_error_counter;
+
+public:
+    explicit RxPSKProcessing(int bits_per_symbol_in)
+        : RxProcessing(-1, -1), bit_error_counter(bits_per_symbol_in)
+    {
+        this->bits_per_symbol = bits_per_symbol_in;
+    }
+
+    void set_parameters(double frequency_in, double dt_in) override {
+        set_frequency(frequency_in);
+        set_dt(dt_in);
+        this->detector = PskDetector(this->bits_per_symbol, max(1, (int) round(1 / (psk_symbol_rate(frequency_in) * dt_in))));
+    }
+
+    // Returns the in phase matched filter output of the last symbol
+    double process_rx_signal(double signal) override {
+        // mix to baseband, see the carrier of TxPSKProcessing
+        double carrier_phase = 2 * M_PI * get_frequency() * get_time();
+        increment_time();
+        if (this->detector.push(complex<double>(2 * signal * sin(carrier_phase), 2 * signal * cos(carrier_phase))))
+            this->bit_error_counter.push(this->detector.get_decision());
+        return this->detector.get_symbol().real();
+    }
+
+    int get_bits_per_symbol() { return this->bits_per_symbol; }
+    BitErrorCounter &get_bit_error_counter() { return this->bit_error_counter; }
+
+    virtual void accept(RxProcessingVisitor const &v) override { v.visit(*this); }
+};
+
+class RxBPSKProcessing : public RxPSKProcessing {
+public:
+    explicit RxBPSKProcessing() : RxPSKProcessing(1) { }
+};
+
+class RxQPSKProcessing : public RxPSKProcessing {
+public:
+    explicit RxQPSKProcessing() : RxPSKProcessing(2) { }
+};
+
+class RxChannelPSKProcessing : public RxChannelProcessing {
+    int bits_per_symbol;
+    PskDetector detector;
+    BitErrorCounter bit_error_counter;
+
+public:
+    explicit RxChannelPSKProcessing(int bits_per_symbol_in) : bit_error_counter(bits_per_symbol_in) {
+        this->bits_per_symbol = bits_per_symbol_in;
+    }
+
+    // The symbol rate must be well below the channel rate 1 / dt_in
+    void set_parameters(double frequency_in, double dt_in) override {
+        this->dt = dt_in;
+        this->detector = PskDetector(this->bits_per_symbol, max(1, (int) round(1 / (psk_symbol_rate(frequency_in) * dt_in))));
+    }
+
+    double process_channel_sample(complex<double> signal) override {
+        // a real carrier Im(p * exp(j w t)) is p / (2 j) at baseband
+        if (this->detector.push(complex<double>(0, 2) * signal))
+            this->bit_error_counter.push(this->detector.get_decision());
+        return this->detector.get_symbol().real();
+    }
+
+    BitErrorCounter &get_bit_error_counter() { return this->bit_error_counter; }
+};
+
+class RxChannelBPSKProcessing : public RxChannelPSKProcessing {
+public:
+    explicit RxChannelBPSKProcessing() : RxChannelPSKProcessing(1) { }
+};
+
+class RxChannelQPSKProcessing : public RxChannelPSKProcessing {
+public:
+    explicit RxChannelQPSKProcessing() : RxChannelPSKProcessing(2) { }
+};
@@ -20,6 +20,12 @@ struct PrintTxProcParams : TxProcessingVisitor {
              << " Time: " << proc.get_time()
              << " Frequency Deviation: " << proc.get_dev() << endl;
     }
+    virtual void visit(TxPSKProcessing & proc) const override {
+        cout << " Tx PSK Processor. Frequency: " << proc.get_frequency()
+             << " Time: " << proc.get_time()
+             << " Bits per Symbol: " << proc.get_bits_per_symbol()
+             << " Samples per Symbol: " << proc.get_samples_per_symbol() << endl;
+    }
 };
 
 struct PrintRxProcParams : RxProcessingVisitor {
@@ -36,4 +42,26 @@ struct PrintRxProcParams : RxProcessingVisitor {
              << " Time: " << proc.get_time()
              << " Frequency Deviation: " << proc.get_dev() << endl;
     }
+    virtual void visit(RxPSKProcessing & proc) const override {
+        cout << " Rx PSK Processor. Frequency: " << proc.get_frequency()
+             << " Time: " << proc.get_time()
+             << " Bits per Symbol: " << proc.get_bits_per_symbol() << endl;
+    }
+};
+
+// Prints the bit error count of digital receivers, nothing for analog ones
+struct PrintBitErrorRate : RxProcessingVisitor {
+    ostream &out;
+
+    PrintBitErrorRate(ostream &out_in) : out(out_in) {}
+
+    virtual void visit(RxProcessing &) const override {}
+    virtual void visit(RxAMProcessing &) const override {}
+    virtual void visit(RxFMProcessing &) const override {}
+    virtual void visit(RxPSKProcessing & proc) const override {
+        BitErrorCounter &counter = proc.get_bit_error_counter();
+        this->out << "Bits: " << counter.get_bits()
+                  << " Bit Errors: " << counter.get_bit_errors()
+                  << " Bit Error Rate: " << counter.get_bit_error_rate() << endl;
+    }
 };
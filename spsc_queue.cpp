@@ -0,0 +1,63 @@
+#include <vector>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+//
+// Lock free single producer / single consumer queue
+//
+// Slots are preallocated and reused, so blocks of samples are written
+// and read in place without copies or allocations. The producer fills
+// the slot returned by producer_slot() and publishes it with push().
+// The consumer reads the slot returned by consumer_slot() and gives it
+// back with pop(). Both sides spin (yielding) when the queue is full or
+// empty. Capacity must be a power of two.
+//
+
+template<typename T>
+class SpscQueue
+{
+	vector<T> slots;
+	size_t mask;
+	// head and tail on separate cache lines to avoid false sharing
+	alignas(64) atomic<size_t> head;	// next slot to be read
+	alignas(64) atomic<size_t> tail;	// next slot to be written
+
+public:
+
+	// "prototype" is copied into every slot, so slots can
+	// be preallocated to the block size
+	SpscQueue(size_t capacity, const T &prototype) : slots(capacity, prototype)
+	{
+		mask = capacity - 1;
+		head.store(0);
+		tail.store(0);
+	}
+
+	T &producer_slot()
+	{
+		size_t t = tail.load(memory_order_relaxed);
+		while (t - head.load(memory_order_acquire) > mask)
+			this_thread::yield();
+		return slots[t & mask];
+	}
+
+	void push()
+	{
+		tail.store(tail.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+
+	T &consumer_slot()
+	{
+		size_t h = head.load(memory_order_relaxed);
+		while (tail.load(memory_order_acquire) == h)
+			this_thread::yield();
+		return slots[h & mask];
+	}
+
+	void pop()
+	{
+		head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+};
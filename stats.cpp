@@ -0,0 +1,221 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+//
+// Live statistics in POSIX shared memory
+//
+// The simulator publishes a small versioned stats block in a shared
+// memory segment (shm_open). Updates use a seqlock: the writer makes
+// the sequence number odd, stores the fields and makes it even again,
+// so it never waits for readers. Readers copy the fields and retry if
+// the sequence number was odd or changed meanwhile. stats_monitor.cpp
+// is a reader that displays the block live.
+//
+// Stage timing is only measured on every timing_interval-th time step,
+// so the hot loop normally pays for one integer compare per stage.
+//
+
+const uint32_t stats_magic = 0x53415453;    // "SATS"
+const uint32_t stats_version = 1;
+const int stats_max_stages = 8;
+const int stats_stage_name_size = 16;
+
+// one consistent copy of the stats
+struct SimulationStats {
+    long step = 0;
+    double sim_time = 0;            // seconds
+    double steps_per_second = 0;    // since last update
+    int active_links = 0;           // tx/rx pairs with signal in flight
+    long buffer_bytes = 0;          // RF delay line memory
+    int num_stages = 0;
+    double stage_seconds[stats_max_stages] = {};   // wall time per step
+    char stage_names[stats_max_stages][stats_stage_name_size] = {};
+};
+
+// layout of the shared memory segment
+struct SharedStatsBlock {
+    atomic<uint32_t> magic;         // set last, once the block is ready
+    uint32_t version;
+    atomic<uint32_t> sequence;      // odd while an update is in progress
+    atomic<int64_t> step;
+    atomic<double> sim_time;
+    atomic<double> steps_per_second;
+    atomic<int32_t> active_links;
+    atomic<int64_t> buffer_bytes;
+    int32_t num_stages;
+    atomic<double> stage_seconds[stats_max_stages];
+    char stage_names[stats_max_stages][stats_stage_name_size];
+};
+
+class StatsPublisher {
+
+    string name;
+    SharedStatsBlock *block = NULL;
+    int timing_interval;
+
+    // stage timing
+    vector<double> stage_seconds;
+    long num_timed_steps = 0;
+    int timing = 0;
+    chrono::steady_clock::time_point stage_start;
+
+    // steps per second
+    long last_step = 0;
+    chrono::steady_clock::time_point last_publish;
+
+public:
+    // Creates segment "name" (e.g. "/satellite_sim_stats"). An empty
+    // name disables the publisher, then every call returns immediately.
+    StatsPublisher(const string &name_in, const vector<string> &stage_names, int timing_interval_in = 64)
+        : name(name_in), timing_interval(timing_interval_in), stage_seconds(stage_names.size())
+    {
+        this->last_publish = chrono::steady_clock::now();
+        if (name_in.empty())
+            return;
+
+        int fd = shm_open(name_in.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0)
+            return;
+        void *addr = MAP_FAILED;
+        if (ftruncate(fd, sizeof(SharedStatsBlock)) == 0)
+            addr = mmap(NULL, sizeof(SharedStatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+            return;
+
+        this->block = new (addr) SharedStatsBlock();
+        this->block->version = stats_version;
+        this->block->num_stages = stage_names.size() < (size_t) stats_max_stages ? stage_names.size() : stats_max_stages;
+        for (int i = 0; i < this->block->num_stages; ++i)
+            strncpy(this->block->stage_names[i], stage_names[i].c_str(), stats_stage_name_size - 1);
+        this->block->magic.store(stats_magic, memory_order_release);
+    }
+
+    int is_enabled() { return this->block != NULL; }
+
+    // call at the start of every time step
+    void start_step(long step) {
+        this->timing = this->block != NULL && step % this->timing_interval == 0;
+        if (!this->timing)
+            return;
+        this->num_timed_steps++;
+        this->stage_start = chrono::steady_clock::now();
+    }
+
+    // call when stage "stage" of the current time step is done
+    void end_stage(int stage) {
+        if (!this->timing)
+            return;
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        this->stage_seconds[stage] += chrono::duration<double>(now - this->stage_start).count();
+        this->stage_start = now;
+    }
+
+    // Publishes the stats. Stage timing is averaged since the
+    // previous call.
+    void publish(long step, double sim_time, int active_links, long buffer_bytes) {
+        if (this->block == NULL)
+            return;
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        double elapsed = chrono::duration<double>(now - this->last_publish).count();
+        double steps_per_second = elapsed > 0 ? (step - this->last_step) / elapsed : 0;
+
+        uint32_t seq = this->block->sequence.load(memory_order_relaxed);
+        this->block->sequence.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        this->block->step.store(step, memory_order_relaxed);
+        this->block->sim_time.store(sim_time, memory_order_relaxed);
+        this->block->steps_per_second.store(steps_per_second, memory_order_relaxed);
+        this->block->active_links.store(active_links, memory_order_relaxed);
+        this->block->buffer_bytes.store(buffer_bytes, memory_order_relaxed);
+        for (int i = 0; i < this->block->num_stages; ++i)
+        {
+            double mean = this->num_timed_steps > 0 ? this->stage_seconds[i] / this->num_timed_steps : 0;
+            this->block->stage_seconds[i].store(mean, memory_order_relaxed);
+            this->stage_seconds[i] = 0;
+        }
+        this->block->sequence.store(seq + 2, memory_order_release);
+
+        this->num_timed_steps = 0;
+        this->last_step = step;
+        this->last_publish = now;
+    }
+
+    ~StatsPublisher() {
+        if (this->block == NULL)
+            return;
+        munmap(this->block, sizeof(SharedStatsBlock));
+        shm_unlink(this->name.c_str());
+    }
+};
+
+class StatsReader {
+
+    const SharedStatsBlock *block = NULL;
+
+public:
+    StatsReader(const string &name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            return;
+        struct stat file_stat;
+        void *addr = MAP_FAILED;
+        if (fstat(fd, &file_stat) == 0 && (size_t) file_stat.st_size >= sizeof(SharedStatsBlock))
+            addr = mmap(NULL, sizeof(SharedStatsBlock), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+            return;
+        this->block = (const SharedStatsBlock *) addr;
+    }
+
+    // 1 if the segment exists and was written by this version
+    int is_valid() {
+        return this->block != NULL && this->block->magic.load(memory_order_acquire) == stats_magic
+            && this->block->version == stats_version;
+    }
+
+    // Copies a consistent snapshot into "stats". Returns 0 if the
+    // writer kept updating during max_tries attempts.
+    int read(SimulationStats &stats, int max_tries = 1000) {
+        if (!is_valid())
+            return 0;
+        for (int tries = 0; tries < max_tries; ++tries)
+        {
+            uint32_t seq = this->block->sequence.load(memory_order_acquire);
+            if (seq & 1)
+                continue;
+            stats.step = this->block->step.load(memory_order_relaxed);
+            stats.sim_time = this->block->sim_time.load(memory_order_relaxed);
+            stats.steps_per_second = this->block->steps_per_second.load(memory_order_relaxed);
+            stats.active_links = this->block->active_links.load(memory_order_relaxed);
+            stats.buffer_bytes = this->block->buffer_bytes.load(memory_order_relaxed);
+            stats.num_stages = this->block->num_stages;
+            for (int i = 0; i < stats.num_stages; ++i)
+            {
+                stats.stage_seconds[i] = this->block->stage_seconds[i].load(memory_order_relaxed);
+                memcpy(stats.stage_names[i], this->block->stage_names[i], stats_stage_name_size);
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if (this->block->sequence.load(memory_order_relaxed) == seq)
+                return 1;
+        }
+        return 0;
+    }
+
+    ~StatsReader() {
+        if (this->block != NULL)
+            munmap((void *) this->block, sizeof(SharedStatsBlock));
+    }
+};
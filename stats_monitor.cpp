@@ -0,0 +1,44 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include "stats.cpp"
+
+//
+// Displays the live stats of a running simulation (see stats.cpp).
+// Build separately:
+//
+// clang++ stats_monitor.cpp -std=c++17 -o stats_monitor -lrt
+//
+// and run like "./stats_monitor" or "./stats_monitor /segment_name".
+//
+
+using namespace std;
+
+int main(int argc, char * argv[])
+{
+    string segment_name = argc > 1 ? argv[1] : "/satellite_sim_stats";
+    double refresh_seconds = 0.5;
+
+    while (true)
+    {
+        StatsReader reader(segment_name);
+        SimulationStats stats;
+        if (!reader.read(stats)) {
+            cout << "Waiting for simulation stats in " << segment_name << endl;
+            this_thread::sleep_for(chrono::duration<double>(1));
+            continue;
+        }
+
+        cout << "Time Step: " << stats.step
+             << ", Simulated Time: " << stats.sim_time << " s"
+             << ", Steps/s: " << fixed << setprecision(0) << stats.steps_per_second << defaultfloat
+             << ", Active Links: " << stats.active_links
+             << ", Buffer Bytes: " << stats.buffer_bytes;
+        for (int i = 0; i < stats.num_stages; ++i)
+            cout << ", " << stats.stage_names[i] << ": " << setprecision(3) << stats.stage_seconds[i] * 1e6 << " us";
+        cout << setprecision(6) << endl;
+
+        this_thread::sleep_for(chrono::duration<double>(refresh_seconds));
+    }
+    return 0;
+}
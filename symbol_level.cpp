@@ -0,0 +1,156 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+
+using namespace std;
+
+//
+// Symbol level link simulation
+//
+// Bit error rates around 1e-6 need about 1e8 bits, far too many to
+// simulate every carrier cycle. With ideal carrier and symbol
+// synchronization the matched filter output of a PSK symbol is the
+// transmitted symbol scaled by the link gain plus Gaussian noise, so a
+// link can be simulated at one sample per symbol instead. Gain, delay
+// and SNR of every link are kept in a LinkTable, which is refreshed
+// from the predicted orbits once per block of symbols.
+//
+// Noise matches the carrier level simulation with the same
+// ChannelImpairments: noise of rms signal_rms * gain / sqrt(snr) per
+// time step dt gives, after the matched filter over N = 1 / (symbol
+// rate * dt) samples, a standard deviation of gain / sqrt(N * snr) per
+// component of a unit symbol.
+//
+// Data bits are a hash of the symbol number, so the delay of the link
+// only shifts which symbol is compared and no data has to be buffered.
+// Noise comes from the counter based generator of channel.cpp, which is
+// vectorized at -O3 -march=native -fno-math-errno.
+//
+// Requires Satellite (satellite.cpp) and ChannelImpairments
+// (channel.cpp).
+//
+
+struct LinkState {
+    double gain;    // propagation loss
+    double delay;   // s
+    double snr;     // linear, see ChannelImpairments::snr. INFINITY without noise
+};
+
+class LinkTable {
+
+    int num_sats;
+    vector<LinkState> links;    // at [tx * num_sats + rx]
+    vector<double> x, y, z;
+
+public:
+    LinkTable(int num_sats_in) : num_sats(num_sats_in), links(num_sats_in * num_sats_in), x(num_sats_in), y(num_sats_in), z(num_sats_in) {}
+
+    // state of every link at time t (s). "channel" may be NULL.
+    void update(vector<Satellite> &satellites, double t, ChannelImpairments *channel) {
+        for (int s = 0; s < this->num_sats; ++s)
+            tie(this->x[s], this->y[s], this->z[s]) = satellites[s].predict_position(t);
+        for (int tx = 0; tx < this->num_sats; ++tx)
+            for (int rx = 0; rx < this->num_sats; ++rx)
+            {
+                double dx = this->x[rx] - this->x[tx], dy = this->y[rx] - this->y[tx], dz = this->z[rx] - this->z[tx];
+                double distance = sqrt(dx * dx + dy * dy + dz * dz);
+                LinkState &link = this->links[tx * this->num_sats + rx];
+                link.gain = propagation_loss(distance);
+                link.delay = distance / 299792458;
+                link.snr = channel != NULL && channel->has_awgn() ? channel->snr(distance) : INFINITY;
+            }
+    }
+
+    const LinkState &get(int tx, int rx) const { return this->links[tx * this->num_sats + rx]; }
+};
+
+struct SymbolLevelResult {
+    long symbols = 0;               // received after the link delay
+    long bits = 0;
+    long bit_errors = 0;
+    double expected_bit_errors = 0; // from the SNR of every symbol
+};
+
+class SymbolLevelSimulator {
+
+    vector<Satellite> &satellites;
+    ChannelImpairments *channel;
+    int bits_per_symbol;
+    double symbol_rate;         // symbols per second
+    double samples_per_symbol;  // of the carrier level simulation
+    int block_size;             // symbols per link table update
+    uint64_t seed;
+    LinkTable link_table;
+    vector<double> noise_i, noise_q;
+
+    // probability that a unit normal variable is above x
+    static double q_function(double x) { return 0.5 * erfc(x * M_SQRT1_2); }
+
+public:
+    // "dt" is the time step of the carrier level simulation the noise
+    // is matched to
+    SymbolLevelSimulator(vector<Satellite> &satellites_in, ChannelImpairments *channel_in, int bits_per_symbol_in, double symbol_rate_in, double dt, int block_size_in, uint64_t seed_in)
+        : satellites(satellites_in), link_table(satellites_in.size()), noise_i(block_size_in), noise_q(block_size_in)
+    {
+        this->channel = channel_in;
+        this->bits_per_symbol = bits_per_symbol_in;
+        this->symbol_rate = symbol_rate_in;
+        this->samples_per_symbol = 1 / (symbol_rate_in * dt);
+        this->block_size = block_size_in;
+        this->seed = seed_in;
+    }
+
+    // Simulates the first "num_symbols" symbol times of link tx -> rx
+    SymbolLevelResult run(int tx, int rx, long num_symbols) {
+        uint64_t data_key = this->seed * 0x9e3779b97f4a7c15ULL + (uint64_t) tx;
+        uint64_t noise_key = this->seed * 0xbf58476d1ce4e5b9ULL + (uint64_t) (tx * this->satellites.size() + rx);
+        double amplitude = this->bits_per_symbol == 1 ? 1 : M_SQRT1_2;
+
+        SymbolLevelResult result;
+        for (long first = 0; first < num_symbols; first += this->block_size)
+        {
+            int n = num_symbols - first < this->block_size ? num_symbols - first : this->block_size;
+            this->link_table.update(this->satellites, first / this->symbol_rate, this->channel);
+            const LinkState &link = this->link_table.get(tx, rx);
+            long delay = lround(link.delay * this->symbol_rate);
+            double gain = link.gain;
+            double noise_sigma = link.gain / sqrt(this->samples_per_symbol * link.snr);
+
+            if (noise_sigma > 0)
+            {
+                gaussian_block(noise_key, 2 * first, this->noise_i.data(), n);
+                gaussian_block(noise_key, 2 * first + n, this->noise_q.data(), n);
+            }
+            else
+            {
+                fill(this->noise_i.begin(), this->noise_i.begin() + n, 0);
+                fill(this->noise_q.begin(), this->noise_q.begin() + n, 0);
+            }
+
+            const double *noise_i = this->noise_i.data(), *noise_q = this->noise_q.data();
+            long errors = 0, received = 0;
+            for (int k = 0; k < n; ++k)
+            {
+                // symbol sent "delay" symbols ago, none before time 0
+                long sent = first + k - delay;
+                long valid = sent >= 0;
+                uint64_t bits = noise_hash(data_key, sent);
+                long b0 = bits & 1, b1 = (bits >> 1) & 1;
+                double r_i = gain * amplitude * (1 - 2 * b0) + noise_sigma * noise_i[k];
+                double r_q = gain * amplitude * (1 - 2 * b1) + noise_sigma * noise_q[k];
+                long symbol_errors = ((r_i < 0) != b0) + (this->bits_per_symbol == 2 && (r_q < 0) != b1);
+                errors += valid * symbol_errors;
+                received += valid;
+            }
+
+            result.symbols += received;
+            result.bits += received * this->bits_per_symbol;
+            result.bit_errors += errors;
+            if (noise_sigma > 0)
+                result.expected_bit_errors += received * this->bits_per_symbol * q_function(gain * amplitude / noise_sigma);
+        }
+        return result;
+    }
+};
@@ -0,0 +1,255 @@
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cmath>
+
+using namespace std;
+
+//
+// Conservative lookahead time tiling
+//
+// A satellite only depends on another one through a link, and nothing
+// sent in a time step reaches another satellite before the link's
+// propagation delay has passed. If every link is at least K time steps
+// long, each satellite can therefore run through a tile of K time
+// steps without waiting for anyone: everything it receives in the tile
+// was sent before the tile started.
+//
+// Before each tile the lookahead K is derived from the geometry: the
+// shortest link from a transmitting satellite, shortened by how fast
+// the two satellites can close in on each other during the tile. A
+// link of distance d between satellites of speeds v1 and v2 stays
+// longer than K c dt for the whole tile if
+//     K <= d / ((c + v1 + v2) dt)
+// Links shorter than a time step still give tiles of one step, like
+// the per sample loop.
+//
+// Satellites are spread over a fixed set of threads, and every thread
+// runs its satellites through the whole tile: receive, demodulate /
+// remodulate (or forward transparently) and then push into the delay
+// line and move the orbit. A satellite stays on the same thread, so its
+// DSP and delay line state stays in that core's cache. Threads only
+// meet at three barriers per tile, instead of once per time step.
+//
+// Satellite 0 transmits, the last one receives and the rest relay, as
+// in main. Requires Satellite (satellite.cpp), AudioSource
+// (data_source.cpp), WavFileSink (audio_file.cpp) and SimulationTrace
+// (trace.cpp).
+//
+
+// Time steps every satellite can run before it needs anything sent
+// from now on, from the current positions and velocities. Satellite 0
+// transmits, the last one receives and the rest relay. At most
+// max_steps, at least 1.
+int conservative_lookahead(vector<Satellite> &satellites, double dt, int max_steps) {
+    const double c = 299792458;
+    int num_sats = satellites.size();
+    int rx_sat = num_sats - 1;
+    vector<double> x(num_sats), y(num_sats), z(num_sats), speed(num_sats);
+    for (int s = 0; s < num_sats; ++s)
+    {
+        double vx, vy, vz;
+        tie(x[s], y[s], z[s]) = satellites[s].get_cartesian_position();
+        tie(vx, vy, vz) = satellites[s].get_velocity();
+        speed[s] = sqrt(vx * vx + vy * vy + vz * vz);
+    }
+
+    double min_steps = max_steps;
+    // rx satellite never transmits
+    for (int u = 0; u < rx_sat; ++u)
+        for (int v = 0; v < num_sats; ++v)
+        {
+            if (u == v)
+                continue;
+            double dx = x[v] - x[u], dy = y[v] - y[u], dz = z[v] - z[u];
+            double steps = sqrt(dx * dx + dy * dy + dz * dz) / ((c + speed[u] + speed[v]) * dt);
+            // also catches NaN positions
+            if (!(steps >= min_steps))
+                min_steps = steps >= 1 ? steps : 1;
+        }
+    return (int) min_steps;
+}
+
+// Spinning barrier for a fixed number of threads, reusable
+class TileBarrier {
+
+    int num_threads;
+    alignas(64) atomic<int> num_waiting;
+    alignas(64) atomic<long> generation;
+
+public:
+    TileBarrier(int num_threads_in) : num_threads(num_threads_in), num_waiting(0), generation(0) {}
+
+    void wait() {
+        long current = this->generation.load(memory_order_acquire);
+        if (this->num_waiting.fetch_add(1, memory_order_acq_rel) + 1 == this->num_threads)
+        {
+            this->num_waiting.store(0, memory_order_relaxed);
+            this->generation.fetch_add(1, memory_order_release);
+            return;
+        }
+        while (this->generation.load(memory_order_acquire) == current)
+            this_thread::yield();
+    }
+};
+
+class TiledEngine {
+
+    vector<Satellite> &satellites;
+    AudioSource &wave_gen;
+    WavFileSink *audio_sink = NULL;     // optional, gets received audio
+    SimulationTrace *trace = NULL;      // optional, records every step
+    int num_sats;
+    int num_threads;
+    int max_tile_size;
+    double dt;
+    int transparent;        // forward RF instead of demodulating / remodulating
+    double relay_gain;      // gain used for transparent forwarding
+
+    TileBarrier barrier;
+    int tile_size = 0;                  // current tile, 0 stops the workers
+    long num_tiles = 0;
+    vector<vector<double>> rx_blocks;   // RF received by each satellite in the tile
+    vector<vector<double>> tx_blocks;   // RF transmitted by each satellite in the tile
+    vector<vector<double>> tile_positions;  // (x, y, z) of each satellite after each step, for the trace
+    vector<double> audio_in;
+    vector<double> audio_out;
+    vector<double> trace_positions;
+
+    // first part of a tile of satellite s: everything up to the delay line
+    void process_tile(int s, int n) {
+        int rx_sat = this->num_sats - 1;
+        if (s == 0)
+        {
+            for (int k = 0; k < n; ++k)
+                this->tx_blocks[0][k] = this->satellites[0].modulate(this->audio_in[k]);
+            return;
+        }
+
+        // nothing sent in this tile has arrived yet, so no delay line
+        // holds samples of the tile
+        vector<double> &rf = this->rx_blocks[s];
+        fill(rf.begin(), rf.begin() + n, 0);
+        for (int u = 0; u < rx_sat; ++u)
+            if (u != s)
+                this->satellites[u].add_field_block_at_satellite(s, rf.data(), n, 0);
+        this->satellites[s].add_receiver_noise_block(rf.data(), n);
+
+        if (s < rx_sat)
+            this->satellites[s].retransmit_block(rf.data(), this->tx_blocks[s].data(), n, this->transparent, this->relay_gain);
+        else
+            for (int k = 0; k < n; ++k)
+                this->audio_out[k] = this->satellites[s].demodulate(rf[k]);
+    }
+
+    // second part, once every satellite has read the delay lines
+    void advance_tile(int s, int n) {
+        if (s < this->num_sats - 1)
+            this->satellites[s].propagate_block(this->tx_blocks[s].data(), n);
+        for (int k = 0; k < n; ++k)
+        {
+            this->satellites[s].move_one_frame();
+            if (this->trace != NULL)
+                tie(this->tile_positions[s][3 * k], this->tile_positions[s][3 * k + 1], this->tile_positions[s][3 * k + 2])
+                    = this->satellites[s].get_cartesian_position();
+        }
+    }
+
+    // one tile of thread "t", which owns satellites t, t + num_threads, ...
+    void run_tile(int t) {
+        for (int s = t; s < this->num_sats; s += this->num_threads)
+            process_tile(s, this->tile_size);
+        this->barrier.wait();
+        for (int s = t; s < this->num_sats; s += this->num_threads)
+            advance_tile(s, this->tile_size);
+        this->barrier.wait();
+    }
+
+    void worker(int t) {
+        while (true)
+        {
+            this->barrier.wait();
+            if (this->tile_size == 0)
+                return;
+            run_tile(t);
+        }
+    }
+
+public:
+    TiledEngine(vector<Satellite> &satellites_in, AudioSource &wave_gen_in, double dt_in, int max_tile_size_in, int num_threads_in, int transparent_in = 0, double relay_gain_in = 1)
+        : satellites(satellites_in), wave_gen(wave_gen_in),
+          barrier(num_threads_in < (int) satellites_in.size() ? num_threads_in : satellites_in.size())
+    {
+        this->num_sats = satellites_in.size();
+        this->num_threads = num_threads_in < this->num_sats ? num_threads_in : this->num_sats;
+        this->max_tile_size = max_tile_size_in;
+        this->dt = dt_in;
+        this->transparent = transparent_in;
+        this->relay_gain = relay_gain_in;
+        this->rx_blocks.assign(this->num_sats, vector<double>(max_tile_size_in));
+        this->tx_blocks.assign(this->num_sats, vector<double>(max_tile_size_in));
+        this->audio_in.resize(max_tile_size_in);
+        this->audio_out.resize(max_tile_size_in);
+        this->trace_positions.resize(3 * this->num_sats);
+    }
+
+    void set_audio_sink(WavFileSink *audio_sink_in) { this->audio_sink = audio_sink_in; }
+
+    void set_trace(SimulationTrace *trace_in) {
+        this->trace = trace_in;
+        this->tile_positions.assign(this->num_sats, vector<double>(3 * this->max_tile_size));
+    }
+
+    void run(long num_time_steps, ostream &ins) {
+        int tx_sat = 0;
+        int rx_sat = this->num_sats - 1;
+
+        // this thread is thread 0
+        vector<thread> workers;
+        for (int t = 1; t < this->num_threads; ++t)
+            workers.emplace_back(&TiledEngine::worker, this, t);
+
+        for (long step = 0; step < num_time_steps; )
+        {
+            long remaining = num_time_steps - step;
+            int n = conservative_lookahead(this->satellites, this->dt, this->max_tile_size);
+            if (n > remaining)
+                n = remaining;
+            for (int k = 0; k < n; ++k)
+                this->audio_in[k] = this->wave_gen.get_next();
+
+            this->tile_size = n;
+            this->barrier.wait();
+            run_tile(0);
+            this->num_tiles++;
+
+            for (int k = 0; k < n; ++k)
+            {
+                if (this->audio_sink != NULL)
+                    this->audio_sink->write(this->audio_out[k]);
+                if (this->trace != NULL)
+                {
+                    for (int s = 0; s < this->num_sats; ++s)
+                        copy(&this->tile_positions[s][3 * k], &this->tile_positions[s][3 * k + 3], &this->trace_positions[3 * s]);
+                    this->trace->record_positions(this->trace_positions.data(), this->num_sats);
+                    this->trace->record_step(this->audio_in[k], this->tx_blocks[tx_sat][k],
+                        this->rx_blocks[rx_sat][k], this->audio_out[k]);
+                }
+                ins << "Time Step: " << step + k << indent << endl;
+                ins << "Transmitted Audio Sample: " << this->audio_in[k] << endl;
+                ins << "Transmitted RF Sample: " << this->tx_blocks[tx_sat][k] << endl;
+                ins << "Received RF Sample: " << this->rx_blocks[rx_sat][k] << endl;
+                ins << "Received Audio Sample: " << this->audio_out[k] << unindent << endl;
+            }
+            step += n;
+        }
+
+        this->tile_size = 0;
+        this->barrier.wait();
+        for (thread &worker : workers)
+            worker.join();
+    }
+
+    long get_num_tiles() { return this->num_tiles; }
+};
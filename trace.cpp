@@ -0,0 +1,24 @@
+#include <vector>
+
+using namespace std;
+
+// Records the sample streams of a simulation run, one entry per time
+// step. Used to compare engines against each other.
+struct SimulationTrace {
+    vector<double> tx_audio;
+    vector<double> tx_rf;
+    vector<double> rx_rf;
+    vector<double> rx_audio;
+    vector<double> positions;   // x, y, z of every satellite, per time step
+
+    void record_step(double tx_audio_in, double tx_rf_in, double rx_rf_in, double rx_audio_in) {
+        this->tx_audio.push_back(tx_audio_in);
+        this->tx_rf.push_back(tx_rf_in);
+        this->rx_rf.push_back(rx_rf_in);
+        this->rx_audio.push_back(rx_audio_in);
+    }
+
+    void record_positions(const double *xyz, int num_sats) {
+        this->positions.insert(this->positions.end(), xyz, xyz + 3 * num_sats);
+    }
+};
@@ -2,13 +2,20 @@
 #include <iostream>
 #include "signal_processing.cpp"
 #include "signal_processing_visitor.cpp"
+#include "channelizer.cpp"
+#include "receiver_bank.cpp"
+#include "capture.cpp"
 
 // initialize factory types
-using AbstractSigProcFactory = signal_processing_factory<TxProcessing, RxProcessing>;
+using AbstractSigProcFactory = signal_processing_factory<TxProcessing, RxProcessing, RxChannelProcessing>;
 using AMProcessingFactory
-= concrete_signal_processing_factory<AbstractSigProcFactory, TxAMProcessing, RxAMProcessing>;
+= concrete_signal_processing_factory<AbstractSigProcFactory, TxAMProcessing, RxAMProcessing, RxChannelAMProcessing>;
 using FMProcessingFactory
-= concrete_signal_processing_factory<AbstractSigProcFactory, TxFMProcessing, RxFMProcessing>;
+= concrete_signal_processing_factory<AbstractSigProcFactory, TxFMProcessing, RxFMProcessing, RxChannelFMProcessing>;
+using BPSKProcessingFactory
+= concrete_signal_processing_factory<AbstractSigProcFactory, TxBPSKProcessing, RxBPSKProcessing, RxChannelBPSKProcessing>;
+using QPSKProcessingFactory
+= concrete_signal_processing_factory<AbstractSigProcFactory, TxQPSKProcessing, RxQPSKProcessing, RxChannelQPSKProcessing>;
 
 // Transmitter class. Each satellite has one. Contains a transmit signal processor
 // and a transmit RF object.
@@ -19,6 +26,9 @@ class Transmitter {
     unique_ptr<TxProcessing> tx_signal_processor;
     unique_ptr<RFTx> tx_rf;
     double last_processed_sample;
+    // optional capture of the audio input and RF output
+    CaptureTap *audio_tap = NULL;
+    CaptureTap *rf_tap = NULL;
 
 public:
     Transmitter(EMField * em_field_in, int sat_id, unique_ptr<AbstractSigProcFactory> &sig_proc_factory, SatellitePositions * sat_pos, double frequency_in, double dt_in) {
@@ -35,6 +45,57 @@ public:
             this->tx_signal_processor->accept(PrintTxProcParams());
         this->last_processed_sample = this->tx_signal_processor->process_tx_signal(signal);
         this->tx_rf->update_field(this->last_processed_sample);
+        if (this->audio_tap != NULL)
+            this->audio_tap->push(signal);
+        if (this->rf_tap != NULL)
+            this->rf_tap->push(this->last_processed_sample);
+    }
+
+    // The two halves of transmit_signal. Used when modulation
+    // and propagation run in different stages.
+    double modulate(double signal) {
+        this->last_processed_sample = this->tx_signal_processor->process_tx_signal(signal);
+        if (this->audio_tap != NULL)
+            this->audio_tap->push(signal);
+        return this->last_processed_sample;
+    }
+
+    void propagate(double rf_sample) {
+        this->tx_rf->update_field(rf_sample);
+        if (this->rf_tap != NULL)
+            this->rf_tap->push(rf_sample);
+    }
+
+    // taps may be NULL
+    void set_capture_taps(CaptureTap *audio_tap_in, CaptureTap *rf_tap_in) {
+        this->audio_tap = audio_tap_in;
+        this->rf_tap = rf_tap_in;
+    }
+
+    // block versions, used by block engines
+    void propagate_block(const double *rf_samples, int n) {
+        this->tx_rf->push_block(rf_samples, n);
+    }
+
+    void add_field_block_at_satellite(int rx_sat_id, double *out, int n, int pushed) {
+        this->tx_rf->add_field_block_at_satellite(rx_sat_id, out, n, pushed);
+    }
+
+    int link_latency(int rx_sat_id) { return this->tx_rf->link_latency(rx_sat_id); }
+
+    double calc_field_at_point(double x, double y, double z) { return this->tx_rf->calc_field_at_point(x, y, z); }
+
+    int is_drained() { return this->tx_rf->is_drained(); }
+
+    int count_active_links() { return this->tx_rf->count_active_links(); }
+    void set_channel(ChannelImpairments *channel) { this->tx_rf->set_channel(channel); }
+    void set_link_gains(const LinkGains *link_gains) { this->tx_rf->set_link_gains(link_gains); }
+    size_t get_buffer_bytes() { return this->tx_rf->get_buffer_bytes(); }
+
+    // skip n silent time steps
+    void skip_time(long n) {
+        this->tx_signal_processor->advance_time(n);
+        this->tx_rf->skip_silence(n);
     }
 
     double get_last_processed_sample() {
@@ -51,6 +112,9 @@ class Receiver {
     unique_ptr<RxProcessing> rx_signal_processor;
     unique_ptr<RFRx> rx_rf;
     double last_received_rf_sample;
+    // optional capture of the RF input and audio output
+    CaptureTap *rf_tap = NULL;
+    CaptureTap *audio_tap = NULL;
 
 public:
     Receiver(EMField * em_field_in, int sat_id, unique_ptr<AbstractSigProcFactory> &sig_proc_factory, SatellitePositions * sat_pos, double frequency_in, double dt_in) {
@@ -65,10 +129,159 @@ public:
     double receive_signal(int print_status) {
         if (print_status)
             this->rx_signal_processor->accept(PrintRxProcParams());
+        return demodulate(receive_rf());
+    }
+
+    // The two halves of receive_signal. Used when reading the
+    // field and demodulation run in different stages.
+    double receive_rf() {
         this->last_received_rf_sample = this->rx_rf->get_field();
-        return this->rx_signal_processor->process_rx_signal(this->last_received_rf_sample);
+        if (this->rf_tap != NULL)
+            this->rf_tap->push(this->last_received_rf_sample);
+        return this->last_received_rf_sample;
+    }
+
+    double demodulate(double rf_sample) {
+        double signal = this->rx_signal_processor->process_rx_signal(rf_sample);
+        if (this->audio_tap != NULL)
+            this->audio_tap->push(signal);
+        return signal;
     }
 
+    // taps may be NULL
+    void set_capture_taps(CaptureTap *rf_tap_in, CaptureTap *audio_tap_in) {
+        this->rf_tap = rf_tap_in;
+        this->audio_tap = audio_tap_in;
+    }
+
+    void set_channel(ChannelImpairments *channel) { this->rx_rf->set_channel(channel); }
+
+    // Adds receiver noise to a block of field summed by a block engine,
+    // in place of receive_rf
+    void add_noise_block(double *rf, int n) { this->rx_rf->add_noise(rf, n); }
+
+    // skip n silent time steps
+    void skip_time(long n) {
+        this->rx_signal_processor->advance_time(n);
+        this->rx_rf->skip(n);
+    }
+
+    void accept(RxProcessingVisitor const &v) { this->rx_signal_processor->accept(v); }
+
+    double get_last_received_rf_sample() {
+        return this->last_received_rf_sample;
+    }
+};
+
+// Multi channel (FDMA) transmitter. Channel i is modulated on carrier
+// frequency_in + i * channel_spacing and all channels are summed into
+// one RF signal.
+class MultiChannelTransmitter {
+    vector<unique_ptr<TxProcessing>> tx_signal_processors;
+    unique_ptr<RFTx> tx_rf;
+    double last_processed_sample;
+
+public:
+    MultiChannelTransmitter(EMField * em_field_in, int sat_id, unique_ptr<AbstractSigProcFactory> &sig_proc_factory, SatellitePositions * sat_pos, double frequency_in, double channel_spacing, int num_channels, double dt_in) {
+        for (int i = 0; i < num_channels; ++i)
+        {
+            this->tx_signal_processors.push_back(sig_proc_factory->create<TxProcessing>());
+            this->tx_signal_processors[i]->set_parameters(frequency_in + i * channel_spacing, dt_in);
+        }
+
+        this->tx_rf = make_unique<RFTx>(em_field_in, sat_id, sat_pos, dt_in);
+    }
+
+    // signals holds one audio sample per channel
+    void transmit_signals(const vector<double> &signals, int print_status) {
+        double rf_sum = 0;
+        for (size_t i = 0; i < this->tx_signal_processors.size(); ++i)
+        {
+            if (print_status)
+                this->tx_signal_processors[i]->accept(PrintTxProcParams());
+            rf_sum += this->tx_signal_processors[i]->process_tx_signal(signals[i]);
+        }
+        this->last_processed_sample = rf_sum;
+        this->tx_rf->update_field(rf_sum);
+    }
+
+    int get_num_channels() { return this->tx_signal_processors.size(); }
+
+    int count_active_links() { return this->tx_rf->count_active_links(); }
+    void set_channel(ChannelImpairments *channel) { this->tx_rf->set_channel(channel); }
+    void set_link_gains(const LinkGains *link_gains) { this->tx_rf->set_link_gains(link_gains); }
+    size_t get_buffer_bytes() { return this->tx_rf->get_buffer_bytes(); }
+
+    double get_last_processed_sample() {
+        return this->last_processed_sample;
+    }
+};
+
+// Multi channel (FDMA) receiver. A single polyphase FFT channelizer
+// splits all channels at once instead of one mixer and low pass
+// filter per channel. Channel outputs are produced at the decimated
+// rate 1 / channel_spacing.
+class ChannelizedReceiver {
+    unique_ptr<PolyphaseChannelizer> channelizer;
+    vector<unique_ptr<RxChannelProcessing>> channel_processors;
+    vector<int> channel_bins;   // channelizer output used by each channel
+    vector<complex<double>> channelizer_out;
+    unique_ptr<RFRx> rx_rf;
+    double last_received_rf_sample;
+
+public:
+    // 1 if the channelizer has a power of two number of bins and every
+    // carrier is a multiple of channel_spacing on a bin below Nyquist
+    static int fits_channelizer(double frequency_in, double channel_spacing, int num_channels, double dt_in) {
+        double bins = 1 / (dt_in * channel_spacing);
+        int num_bins = (int) round(bins);
+        if (num_bins < 2 || fabs(bins - num_bins) > 1e-9 * bins || (num_bins & (num_bins - 1)) != 0)
+            return 0;
+        for (int i = 0; i < num_channels; ++i)
+        {
+            double carrier_bin = (frequency_in + i * channel_spacing) / channel_spacing;
+            int bin = (int) round(carrier_bin);
+            if (fabs(carrier_bin - bin) > 1e-9 * (fabs(carrier_bin) + 1) || bin < 0 || bin >= num_bins / 2)
+                return 0;
+        }
+        return 1;
+    }
+
+    // Carrier frequencies must be multiples of channel_spacing, and
+    // 1 / (dt_in * channel_spacing) must be a power of two. Check the
+    // channel plan with fits_channelizer first.
+    ChannelizedReceiver(EMField * em_field_in, int sat_id, unique_ptr<AbstractSigProcFactory> &sig_proc_factory, double frequency_in, double channel_spacing, int num_channels, double dt_in) {
+        int num_bins = (int) round(1 / (dt_in * channel_spacing));
+        this->channelizer = make_unique<PolyphaseChannelizer>(num_bins);
+
+        for (int i = 0; i < num_channels; ++i)
+        {
+            double channel_frequency = frequency_in + i * channel_spacing;
+            this->channel_bins.push_back((int) round(channel_frequency / channel_spacing));
+            this->channel_processors.push_back(sig_proc_factory->create<RxChannelProcessing>());
+            this->channel_processors[i]->set_parameters(channel_frequency, dt_in * num_bins);
+        }
+
+        this->rx_rf = make_unique<RFRx>(em_field_in, sat_id);
+    }
+
+    // Returns 1 and writes one audio sample per channel into
+    // "signals" when a new channelizer output block is ready.
+    int receive_signals(vector<double> &signals) {
+        this->last_received_rf_sample = this->rx_rf->get_field();
+        if (!this->channelizer->push(this->last_received_rf_sample, this->channelizer_out))
+            return 0;
+
+        signals.resize(this->channel_processors.size());
+        for (size_t i = 0; i < this->channel_processors.size(); ++i)
+            signals[i] = this->channel_processors[i]->process_channel_sample(this->channelizer_out[this->channel_bins[i]]);
+        return 1;
+    }
+
+    int get_num_channels() { return this->channel_processors.size(); }
+
+    void set_channel(ChannelImpairments *channel) { this->rx_rf->set_channel(channel); }
+
     double get_last_received_rf_sample() {
         return this->last_received_rf_sample;
     }
@@ -0,0 +1,142 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+//
+// Window search
+//
+// Finds the time windows in which the margin of each of many pairs is
+// positive, e.g. a satellite above a ground station's elevation mask
+// (ground_station.cpp) or two satellites in contact
+// (contact_windows.cpp). Satellites are stepped with the orbit the run
+// uses (Satellite::advance_orbit_state) on a coarse time grid, and the
+// margin of every pair is evaluated at each grid point. A change of
+// sign between two grid points is refined by bisection to the time
+// step, stepping only the pair's satellites forward from the earlier
+// grid point, so each refinement costs about one grid step of orbit.
+// The grid step must be shorter than the shortest window or gap.
+//
+// The margin is a functor called as
+//     double margin(int pair, long step, const vector<OrbitState> &states)
+// with states[s] the orbit of satellite s at time step "step". Only the
+// states of the pair's own satellites are valid while refining.
+//
+// Requires Satellite (satellite.cpp).
+//
+
+// pair whose margin depends on satellite sat_a and, unless -1, sat_b
+struct MarginPair {
+    int sat_a;
+    int sat_b;
+};
+
+// first and last time step in which the margin of "pair" is positive
+struct MarginWindow {
+    int pair;
+    long start;
+    long end;
+};
+
+template<typename Margin>
+class WindowSearch {
+
+    vector<Satellite> &satellites;
+    const vector<MarginPair> &pairs;
+    Margin margin;
+    // orbits of one pair's satellites while refining, at the lower end
+    // of the interval and at its middle
+    vector<OrbitState> lower;
+    vector<OrbitState> middle;
+
+    // copies the states of the pair's satellites from "from" to "to",
+    // advanced by n time steps
+    void advance_pair(const MarginPair &pair, const vector<OrbitState> &from, vector<OrbitState> &to, long n) {
+        int sats[] = {pair.sat_a, pair.sat_b};
+        for (int s : sats)
+        {
+            if (s < 0)
+                continue;
+            to[s] = from[s];
+            this->satellites[s].advance_orbit_state(to[s], n);
+        }
+    }
+
+    // First time step in (step0, step1] at which the margin of pair p
+    // has the sign it has at step1, from the orbits "states" at step0.
+    long refine(int p, const vector<OrbitState> &states, long step0, long step1) {
+        const MarginPair &pair = this->pairs[p];
+        advance_pair(pair, states, this->lower, 0);
+        int rising = this->margin(p, step0, this->lower) <= 0;
+        while (step1 - step0 > 1)
+        {
+            long step = step0 + (step1 - step0) / 2;
+            advance_pair(pair, this->lower, this->middle, step - step0);
+            if ((this->margin(p, step, this->middle) > 0) == rising)
+                step1 = step;
+            else
+            {
+                step0 = step;
+                swap(this->lower, this->middle);
+            }
+        }
+        return step1;
+    }
+
+public:
+    WindowSearch(vector<Satellite> &satellites_in, const vector<MarginPair> &pairs_in, Margin margin_in)
+        : satellites(satellites_in), pairs(pairs_in), margin(margin_in),
+          lower(satellites_in.size()), middle(satellites_in.size()) {}
+
+    // Windows of all pairs in the next horizon_steps time steps, on a
+    // grid of grid_steps. Windows open at the start or end of the
+    // horizon are cut off there.
+    vector<MarginWindow> find(long horizon_steps, long grid_steps) {
+        int num_sats = this->satellites.size();
+        int num_pairs = this->pairs.size();
+        grid_steps = max(1L, grid_steps);
+
+        // orbits of all satellites at this and the previous grid point
+        vector<OrbitState> states(num_sats), prev_states(num_sats);
+        vector<unsigned char> open(num_pairs);
+        vector<long> start(num_pairs);
+        for (int s = 0; s < num_sats; ++s)
+            states[s] = this->satellites[s].get_orbit_state();
+
+        vector<MarginWindow> windows;
+        long step = 0, prev_step = 0;
+        while (1)
+        {
+            for (int p = 0; p < num_pairs; ++p)
+            {
+                int positive = this->margin(p, step, states) > 0;
+                if (positive == open[p])
+                    continue;
+                open[p] = positive;
+                if (step == 0)
+                    start[p] = 0;
+                else if (positive)
+                    start[p] = refine(p, prev_states, prev_step, step);
+                else
+                    windows.push_back({p, start[p], refine(p, prev_states, prev_step, step) - 1});
+            }
+
+            if (step >= horizon_steps)
+                break;
+            prev_states = states;
+            prev_step = step;
+            long n = min(grid_steps, horizon_steps - step);
+            for (int s = 0; s < num_sats; ++s)
+                this->satellites[s].advance_orbit_state(states[s], n);
+            step += n;
+        }
+
+        // still open at the end of the horizon
+        for (int p = 0; p < num_pairs; ++p)
+            if (open[p])
+                windows.push_back({p, start[p], horizon_steps});
+        return windows;
+    }
+};